@@ -0,0 +1,21 @@
+#version 330 core
+layout (location = 0) in vec2 aCorner;	// Unit quad corner, -1 to 1
+layout (location = 1) in vec2 iCenter;	// Per instance, in pixels
+layout (location = 2) in float iRadius;
+layout (location = 3) in vec4 iColor;
+
+uniform mat4 uProjection;
+
+out vec2 vLocal;
+out float vRadius;
+out vec4 vColor;
+
+void main() {
+	// One extra pixel so the quad doesn't cut the anti-aliased edge
+	vLocal = aCorner * (iRadius + 1.0);
+	vec2 pos = iCenter + vLocal;
+
+	gl_Position = uProjection * vec4(pos, 0.0, 1.0);
+	vRadius = iRadius;
+	vColor = iColor;
+}
@@ -5,6 +5,8 @@
 #include <string.h>
 #include <limits.h>
 #include <time.h>
+#include <assert.h>
+#include <ctype.h>
 
 #include <GL/glew.h>
 
@@ -15,30 +17,106 @@
 // Ye
 #include "utils.h"
 #include "vector.h"
+#include "rng.h"
+#include "kernels.h"
+#include "threadpool.h"
 
 // Constants or macros idk
 
-#define MAX_TRIANGLES INT_MAX/2000
+// Triangles per region to start with, the buffer doubles whenever a frame needs more
+#define TRIANGLE_START_CAPACITY 128
 const int MAX_TRAIL_POINTS = INT_MAX/5000;
 
 #define FLOAT2_TO_VEC2(dest, f) glm_vec2_copy((vec2){(f).x, (f).y}, dest) // gipiti
 #define VEC2_TO_FLOAT2(v) ((float2){(v)[0], (v)[1]})
 
 const GLuint WIDTH = 1280; const GLuint HEIGHT = 720;
-const uint16_t CIRC_RES = 32;
 
 GLuint triangleVAO, triangleVBO;
 GLuint shaderProgram;
+GLint projectionLoc;
+mat4 projection;
+
+GLuint circleVAO, circleQuadVBO, circleInstanceVBO;
+GLuint circleShaderProgram;
+GLint circleProjectionLoc;
 
 #define G 667.4f
 
+typedef enum SolverMode {
+    SOLVER_IMPULSE,     // Gravity + hard sphere pushes
+    SOLVER_SPH,         // Smoothed particle hydrodynamics
+    SOLVER_PBF          // Position based fluids (Macklin & Muller 2013)
+} SolverMode;
+
+const char* solverNames[] = {"impulse", "sph", "pbf"};
+
+// Time spent in every pass of the step, the headless mode reports them
+typedef enum ProfilePhase {
+    PHASE_INTEGRATE,
+    PHASE_GRID,
+    PHASE_COLLISIONS,
+    PHASE_WORLD_BOX,
+    PHASE_NEIGHBOURS,
+    PHASE_DENSITY,
+    PHASE_FORCES,
+    PHASE_CONSTRAINTS,
+    PHASE_VISCOSITY,
+    PHASE_REORDER,
+    PHASE_COUNT
+} ProfilePhase;
+
+const char* phaseNames[PHASE_COUNT] = {
+    "integrate", "grid", "collisions", "world_box", "neighbours",
+    "density", "forces", "constraints", "viscosity", "reorder"
+};
+
+typedef struct SPHSettings {
+    float h;            // Smoothing radius (px), also the cell size of the SPH grid
+    float mass;
+    float restDensity;
+    float gasConstant;  // Stiffness of p = k * (rho - rho0)
+    float viscosity;
+    float timestep;     // Largest dt of one SPH step, sets the default substeps of the fixed step
+} SPHSettings;
+
+// PBF particles have unit mass
+typedef struct PBFSettings {
+    float h;            // Smoothing radius (px)
+    float restDensity;
+    int iterations;     // Density constraint iterations per step
+    float timestep;     // Largest dt of one PBF step, it's stable at a whole frame so one substep is enough
+    float relaxation;   // Epsilon added to the lambda denominator
+    float tensileK;     // Strength of the s_corr term that stops particles from clumping
+    float viscosity;    // XSPH velocity smoothing
+} PBFSettings;
+
+// Particles get sorted along a Z curve over the grid cells every now and then, so particles
+// that are close in space are close in memory too and the neighbour passes hit the cache
+typedef struct ReorderSettings {
+    int interval;           // Sort every interval steps, 0 to only use the miss rate
+    float missRate;         // Sort when more than this fraction of same cell pairs are a cache line apart, 0 to disable
+} ReorderSettings;
+
 typedef struct EngineSettings {
     bool enableBodyGravity;
     bool enableCollisions;
     bool enableWorldBoxGravity;
     bool enableWorldBoxPhysicsBox;
+    SolverMode solver;
+    SPHSettings sph;
+    PBFSettings pbf;
+    ReorderSettings reorder;
 } EngineSettings;
 
+// Physics runs at a fixed rate whatever the frame rate is, a frame only decides how many steps to run
+typedef struct FixedTimestep {
+    double dt;              // Length of one step (s)
+    int substeps;           // updateScene calls per step, each one dt / substeps long, 0 picks it from the solver
+    int maxStepsPerFrame;   // Time past this many steps is dropped, the sim slows down instead of spiralling
+    double accumulator;     // Time not simulated yet, carried to the next frame
+} FixedTimestep;
+
 /* Utils */
 
 typedef vec2 pos2;
@@ -135,6 +213,83 @@ const float particleViscosity = 0.98f;
 
 VECTOR_DEFINE(Particle)
 
+// Simulation side storage of the particles, every field in its own aligned array so a
+// pass only streams the fields it uses. Vector_Particle is only filled for rendering
+#define PARTICLE_SOA_ALIGNMENT 32
+
+typedef struct ParticleSoA {
+    float* x;
+    float* y;
+    float* vx;
+    float* vy;
+    uint32_t* staticMask;   // Bit i is set if particle i is static
+    size_t length;
+    size_t capacity;
+} ParticleSoA;
+
+// Uniform grid over the world box, cell size is the particle diameter
+typedef struct ParticleGrid {
+    float cellSize;
+    float2 origin;
+    int cols;
+    int rows;
+    int* cellStart;      // cols * rows + 1, particles of cell c are cellParticles[cellStart[c]..cellStart[c + 1]]
+    int* cellParticles;  // Particle indices sorted by cell
+    int* particleCell;   // Cell of each particle
+    int* workerCounts;   // Per worker histograms (workers * cols * rows) for the parallel build
+    int workers;
+    size_t capacity;
+} ParticleGrid;
+
+// Neighbours of every particle inside the smoothing radius, built once per SPH step
+// Neighbours of i are indices[start[i]..start[i + 1]] and dist holds |pos_i - pos_j|
+typedef struct NeighbourList {
+    int* start;
+    int* indices;
+    float* dist;
+    size_t count;
+    size_t capacity;
+    size_t particleCapacity;
+} NeighbourList;
+
+// Per particle SPH quantities, kept outside Particle so the other solvers don't pay for them
+typedef struct SPHBuffers {
+    float* density;
+    float* pressure;
+    float2* acc;
+    size_t capacity;
+} SPHBuffers;
+
+typedef struct PBFBuffers {
+    float* prevX;       // Positions at the start of the step
+    float* prevY;
+    float* lambda;
+    float2* delta;      // Position corrections, reused for the XSPH velocities
+    size_t capacity;
+} PBFBuffers;
+
+// Positions before the last fixed step, rendering blends from these to the current ones
+typedef struct ParticleSnapshot {
+    float* x;
+    float* y;
+    size_t length;
+    size_t capacity;
+} ParticleSnapshot;
+
+typedef struct ParticleReorder {
+    uint32_t* keys;         // Morton code of the cell of every particle
+    uint32_t* order;        // After the sort, order[i] is the old index of the particle that moves to i
+    uint32_t* tmpKeys;
+    uint32_t* tmpOrder;
+    float* scratch;         // Gather target, swapped with the particle array it was gathered from
+    uint32_t* scratchMask;
+    int* workerCounts;      // workers * 256 digit histograms
+    int workers;
+    size_t capacity;
+    int stepsSinceSort;
+    int sorts;
+} ParticleReorder;
+
 typedef struct Trail {
     Vector_float2 points;
     Color col;
@@ -157,13 +312,46 @@ typedef struct Triangle {
     Vertex vertices[3];
 } Triangle;
 
+// Circles are drawn as instances of a single quad, the fragment shader cuts the circle out
+typedef struct CircleInstance {
+    float2 center;
+    float radius;
+    Color col;
+} CircleInstance;
+
+VECTOR_DEFINE(CircleInstance)
+
+// Triangles are written straight into mapped GPU memory. With GL_ARB_buffer_storage the
+// buffer is mapped once and split in TRIANGLE_REGIONS regions, the CPU fills one while the GPU
+// still draws the others. Without it the buffer is orphaned and mapped again every frame
+#define TRIANGLE_REGIONS 3
+
 typedef struct TriangleBuffer {
-    Triangle triangles[MAX_TRIANGLES];
+    Triangle* triangles;    // Region of this frame, only valid between beginTriangles and sendTrianglesToGPU
     int count;
+    int capacity;           // Triangles per region
 } TriangleBuffer;
 
+typedef struct TriangleStream {
+    bool persistent;
+    Triangle* mapped;       // Start of the persistent mapping
+    int region;
+    GLsync fences[TRIANGLE_REGIONS];
+} TriangleStream;
+
 // Global
-TriangleBuffer triangleBuffer = {{}, 0};
+TriangleBuffer triangleBuffer = {NULL, 0, 0};
+TriangleStream triangleStream = {false, NULL, 0, {NULL}};
+Vector_CircleInstance circleBuffer = {NULL, 0, 0};
+ThreadPool threadPool;
+ParticleGrid particleGrid;
+ParticleGrid fluidGrid;
+NeighbourList neighbourList;
+ParticleSnapshot previousState;
+ParticleReorder particleReorder;
+double phaseTimes[PHASE_COUNT];
+SPHBuffers sphBuffers;
+PBFBuffers pbfBuffers;
 
 // Some CONSTANTS
 const float2 screenCenter = {WIDTH / 2.0f, HEIGHT / 2.0f};
@@ -171,14 +359,43 @@ const Rectangle screenBox = {{0.0f, 0.0f}, {WIDTH, HEIGHT}};
 
 const float2 gravity_acc = {0.0f, 981.0f};
 
-float2 toNDC(float2 screenPos) {
-    return (float2){
-        2.0f * screenPos.x / WIDTH  - 1.0f,
-        1.0f - 2.0f * screenPos.y / HEIGHT
-    };
+// Pixels (origin at the top left, y down) to clip space, done by the vertex shader
+// Panning or zooming only changes this matrix, the geometry stays in pixels
+void updateProjection(float2 pan, float zoom) {
+    glm_ortho(pan.x, pan.x + WIDTH / zoom, pan.y + HEIGHT / zoom, pan.y, -1.0f, 1.0f, projection);
 }
 
 /* Initialization(s) */
+
+// Storage for the buffer bound to GL_ARRAY_BUFFER, capacity triangles per region
+void allocateTriangleStorage(int capacity) {
+    triangleBuffer.capacity = capacity;
+
+    if(triangleStream.persistent) {
+        GLsizeiptr size = (GLsizeiptr)sizeof(Triangle) * capacity * TRIANGLE_REGIONS;
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+        glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+        triangleStream.mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+        if(!triangleStream.mapped) {
+            crash("Failed to map the triangle buffer");
+        }
+    } else {
+        glBufferData(GL_ARRAY_BUFFER, sizeof(Triangle) * capacity, NULL, GL_STREAM_DRAW);
+    }
+}
+
+// The VAO keeps the buffer it was set up with, so this runs again when the buffer is replaced
+void setTriangleAttributes() {
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE,
+                          sizeof(Vertex), (void*)(offsetof(Vertex, pos)));
+    glEnableVertexAttribArray(0);
+
+    glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+                          sizeof(Vertex), (void*)(offsetof(Vertex, col)));
+    glEnableVertexAttribArray(1);
+}
+
 void initTriangleRenderer(GLuint* triangleVAO, GLuint* triangleVBO) {
     glGenVertexArrays(1, triangleVAO);
     glGenBuffers(1, triangleVBO);
@@ -186,15 +403,49 @@ void initTriangleRenderer(GLuint* triangleVAO, GLuint* triangleVBO) {
     glBindVertexArray(*triangleVAO);
     glBindBuffer(GL_ARRAY_BUFFER, *triangleVBO);
 
-    glBufferData(GL_ARRAY_BUFFER, sizeof(Triangle) * MAX_TRIANGLES, NULL, GL_DYNAMIC_DRAW);
+    triangleStream.persistent = GLEW_ARB_buffer_storage;
+    allocateTriangleStorage(TRIANGLE_START_CAPACITY);
+    setTriangleAttributes();
 
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE,
-                          sizeof(Vertex), (void*)(offsetof(Vertex, pos)));
+    glBindVertexArray(0);
+}
+
+void initCircleRenderer(GLuint* circleVAO, GLuint* quadVBO, GLuint* instanceVBO) {
+    const float corners[] = {
+        -1.0f, -1.0f,
+         1.0f, -1.0f,
+        -1.0f,  1.0f,
+         1.0f,  1.0f
+    };
+
+    glGenVertexArrays(1, circleVAO);
+    glGenBuffers(1, quadVBO);
+    glGenBuffers(1, instanceVBO);
+
+    glBindVertexArray(*circleVAO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, *quadVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
 
-    glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE,
-                          sizeof(Vertex), (void*)(offsetof(Vertex, col)));
+    // The instance buffer gets its size on the first upload
+    glBindBuffer(GL_ARRAY_BUFFER, *instanceVBO);
+
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE,
+                          sizeof(CircleInstance), (void*)(offsetof(CircleInstance, center)));
     glEnableVertexAttribArray(1);
+    glVertexAttribDivisor(1, 1);
+
+    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE,
+                          sizeof(CircleInstance), (void*)(offsetof(CircleInstance, radius)));
+    glEnableVertexAttribArray(2);
+    glVertexAttribDivisor(2, 1);
+
+    glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+                          sizeof(CircleInstance), (void*)(offsetof(CircleInstance, col)));
+    glEnableVertexAttribArray(3);
+    glVertexAttribDivisor(3, 1);
 
     glBindVertexArray(0);
 }
@@ -243,29 +494,126 @@ GLuint createShaderProgram(const char* vertSrc, const char* fragSrc) {
 }
 
 /* Used*/
+
+// Starts the triangles of a frame, call it before any draw
+void beginTriangles() {
+    triangleBuffer.count = 0;
+
+    if(triangleStream.persistent) {
+        int region = triangleStream.region;
+
+        // Only blocks if the GPU is still reading this region from TRIANGLE_REGIONS frames ago
+        GLsync fence = triangleStream.fences[region];
+        if(fence) {
+            while(glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {}
+            glDeleteSync(fence);
+            triangleStream.fences[region] = NULL;
+        }
+
+        triangleBuffer.triangles = triangleStream.mapped + (size_t)region * triangleBuffer.capacity;
+    } else {
+        GLsizeiptr size = sizeof(Triangle) * triangleBuffer.capacity;
+
+        // Orphaning, the driver hands out fresh memory and keeps the old one alive for the draw in flight
+        glBindBuffer(GL_ARRAY_BUFFER, triangleVBO);
+        glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+        triangleBuffer.triangles = glMapBufferRange(GL_ARRAY_BUFFER, 0, size,
+                                                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    }
+}
+
 void sendTrianglesToGPU() {
     glUseProgram(shaderProgram);
+    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, (float*)projection);
     glBindVertexArray(triangleVAO);
     glBindBuffer(GL_ARRAY_BUFFER, triangleVBO);
 
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Triangle) * triangleBuffer.count, triangleBuffer.triangles);
-    glDrawArrays(GL_TRIANGLES, 0, triangleBuffer.count * 3);
+    if(triangleStream.persistent) {
+        int first = triangleStream.region * triangleBuffer.capacity * 3;
+        glDrawArrays(GL_TRIANGLES, first, triangleBuffer.count * 3);
+
+        triangleStream.fences[triangleStream.region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        triangleStream.region = (triangleStream.region + 1) % TRIANGLE_REGIONS;
+    } else {
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glDrawArrays(GL_TRIANGLES, 0, triangleBuffer.count * 3);
+    }
+    triangleBuffer.triangles = NULL;
 
     glBindVertexArray(0);
 
 }
 
-// Prob gonna change it to GPU side rendering, like \/ gonna disappear (probably)
-void drawTriangle(Triangle* triangle) {
-    if (triangleBuffer.count >= MAX_TRIANGLES) return;
+void sendCirclesToGPU() {
+    if(circleBuffer.length == 0) return;
+
+    glUseProgram(circleShaderProgram);
+    glUniformMatrix4fv(circleProjectionLoc, 1, GL_FALSE, (float*)projection);
+
+    glBindVertexArray(circleVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, circleInstanceVBO);
+
+    // Reallocating every frame lets the driver hand out fresh memory instead of waiting on the last draw
+    glBufferData(GL_ARRAY_BUFFER, sizeof(CircleInstance) * circleBuffer.length, circleBuffer.data, GL_STREAM_DRAW);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, circleBuffer.length);
 
-    Triangle ndcTriangle = *triangle;
-    for(int i = 0; i < 3; i++) {
-        ndcTriangle.vertices[i].pos = toNDC(triangle->vertices[i].pos);
+    glBindVertexArray(0);
+}
+
+// Called when a frame runs out of room. The triangles already written are copied on the GPU
+// to a new buffer twice as big and the frame carries on there, nothing gets dropped
+void growTriangleBuffer() {
+    GLintptr usedOffset = 0;
+    if(triangleStream.persistent) {
+        usedOffset = (GLintptr)sizeof(Triangle) * triangleStream.region * triangleBuffer.capacity;
     }
+    GLsizeiptr used = (GLsizeiptr)sizeof(Triangle) * triangleBuffer.count;
+
+    glBindBuffer(GL_COPY_READ_BUFFER, triangleVBO);
+    // A persistent mapping can stay while the GPU copies from it, a normal one can't
+    if(!triangleStream.persistent) {
+        glUnmapBuffer(GL_COPY_READ_BUFFER);
+    }
+
+    GLuint newVBO;
+    glGenBuffers(1, &newVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, newVBO);
+    allocateTriangleStorage(triangleBuffer.capacity * 2);
+
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_ARRAY_BUFFER, usedOffset, 0, used);
+
+    // The GPU keeps the old buffer alive until the draws still using it are done
+    glDeleteBuffers(1, &triangleVBO);
+    triangleVBO = newVBO;
+
+    for(int i = 0; i < TRIANGLE_REGIONS; i++) {
+        if(triangleStream.fences[i]) {
+            glDeleteSync(triangleStream.fences[i]);
+            triangleStream.fences[i] = NULL;
+        }
+    }
+    triangleStream.region = 0;
+
+    if(triangleStream.persistent) {
+        triangleBuffer.triangles = triangleStream.mapped;
+    } else {
+        // No invalidate bit, the copied triangles have to stay. This map waits for the copy
+        triangleBuffer.triangles = glMapBufferRange(GL_ARRAY_BUFFER, 0, sizeof(Triangle) * triangleBuffer.capacity,
+                                                    GL_MAP_WRITE_BIT);
+    }
+
+    glBindVertexArray(triangleVAO);
+    setTriangleAttributes();
+    glBindVertexArray(0);
+}
+
+// Prob gonna change it to GPU side rendering, like \/ gonna disappear (probably)
+void drawTriangle(Triangle* triangle) {
+    if (!triangleBuffer.triangles) return;
+    if (triangleBuffer.count >= triangleBuffer.capacity) growTriangleBuffer();
 
-    if (triangleBuffer.count >= MAX_TRIANGLES) return; // safety
-    triangleBuffer.triangles[triangleBuffer.count++] = ndcTriangle;
+    // Write only, the mapped memory is usually write combined and slow to read back
+    triangleBuffer.triangles[triangleBuffer.count++] = *triangle;
 }
 
 void drawRectangle(Rectangle rect) {
@@ -322,28 +670,7 @@ void drawLine(Line line) {
 }
 
 void drawCircle(float r, float2 pos, Color col) {
-    float theta = (2 * M_PI) / CIRC_RES;
-
-    for(int i = 0; i < CIRC_RES; i++) {
-        float theta_i = theta*i;
-        float theta_i_2 = theta * (i+1);
-
-        float2 pos_theta_i = {r * cos(theta_i), r * sin(theta_i)};
-        float2 pos_theta_i2 = {r * cos(theta_i_2), r * sin(theta_i_2)};
-
-        float2 final_pos_i = {pos.x + pos_theta_i.x, pos.y + pos_theta_i.y};
-        float2 final_pos_i2 = {pos.x + pos_theta_i2.x, pos.y + pos_theta_i2.y};
-
-        Triangle fragCircle = {
-            {
-                {pos, col},
-                {final_pos_i, col},
-                {final_pos_i2, col}
-            }
-        };
-
-        drawTriangle(&fragCircle);
-    }
+    append_vector_CircleInstance(&circleBuffer, (CircleInstance){pos, r, col});
 }
 
 void updateTrail(Trail* trail, float2 pos) {
@@ -453,17 +780,308 @@ void resolveCircleCollision(PhysicBody* a, PhysicBody* b) {
     }
 }
 
-void resolveCircleCollisionParticles(Particle* a, Particle* b) {
-    float2 delta = float2_sub(b->pos, a->pos);
-    float dist = sqrtf(delta.x*delta.x + delta.y*delta.y);
+/* Profiling */
+
+double beginPhase() {
+    return get_time_seconds();
+}
+
+void endPhase(ProfilePhase phase, double start) {
+    phaseTimes[phase] += get_time_seconds() - start;
+}
+
+/* Particle storage */
+
+void initParticleSoA(ParticleSoA* particles) {
+    particles->x = NULL;
+    particles->y = NULL;
+    particles->vx = NULL;
+    particles->vy = NULL;
+    particles->staticMask = NULL;
+    particles->length = 0;
+    particles->capacity = 0;
+}
+
+void freeParticleSoA(ParticleSoA* particles) {
+    aligned_free(particles->x);
+    aligned_free(particles->y);
+    aligned_free(particles->vx);
+    aligned_free(particles->vy);
+    free(particles->staticMask);
+    initParticleSoA(particles);
+}
+
+float* growAlignedFloats(float* old, size_t length, size_t capacity) {
+    float* p = aligned_malloc(PARTICLE_SOA_ALIGNMENT, capacity * sizeof(float));
+    assert(p && "aligned_malloc failed");
+    if(old) memcpy(p, old, length * sizeof(float));
+    aligned_free(old);
+    return p;
+}
+
+void reserveParticleSoA(ParticleSoA* particles, size_t capacity) {
+    if(capacity <= particles->capacity) return;
+
+    // Keep the capacity a multiple of 8 so SIMD loops can read whole registers
+    capacity = (capacity + 7) & ~(size_t)7;
+
+    particles->x = growAlignedFloats(particles->x, particles->length, capacity);
+    particles->y = growAlignedFloats(particles->y, particles->length, capacity);
+    particles->vx = growAlignedFloats(particles->vx, particles->length, capacity);
+    particles->vy = growAlignedFloats(particles->vy, particles->length, capacity);
+
+    size_t oldWords = (particles->capacity + 31) / 32;
+    size_t newWords = (capacity + 31) / 32;
+    uint32_t* mask = realloc(particles->staticMask, newWords * sizeof(uint32_t));
+    assert(mask && "realloc failed");
+    memset(mask + oldWords, 0, (newWords - oldWords) * sizeof(uint32_t));
+    particles->staticMask = mask;
+
+    particles->capacity = capacity;
+}
+
+bool isParticleStatic(ParticleSoA* particles, int i) {
+    return (particles->staticMask[i >> 5] >> (i & 31)) & 1;
+}
+
+void setParticleStatic(ParticleSoA* particles, int i, bool value) {
+    if(value) { particles->staticMask[i >> 5] |= (1U << (i & 31)); }
+    else { particles->staticMask[i >> 5] &= ~(1U << (i & 31)); }
+}
+
+void appendParticleSoA(ParticleSoA* particles, Particle particle) {
+    if(particles->length >= particles->capacity) {
+        reserveParticleSoA(particles, particles->capacity ? particles->capacity * 2 : 64);
+    }
+
+    int i = particles->length++;
+    particles->x[i] = particle.pos.x;
+    particles->y[i] = particle.pos.y;
+    particles->vx[i] = particle.vel.x;
+    particles->vy[i] = particle.vel.y;
+    setParticleStatic(particles, i, particle.Static);
+}
+
+void initParticleSnapshot(ParticleSnapshot* snapshot) {
+    snapshot->x = NULL;
+    snapshot->y = NULL;
+    snapshot->length = 0;
+    snapshot->capacity = 0;
+}
+
+void freeParticleSnapshot(ParticleSnapshot* snapshot) {
+    aligned_free(snapshot->x);
+    aligned_free(snapshot->y);
+    initParticleSnapshot(snapshot);
+}
+
+void saveParticleSnapshot(ParticleSnapshot* snapshot, ParticleSoA* particles) {
+    if(particles->capacity > snapshot->capacity) {
+        snapshot->x = growAlignedFloats(snapshot->x, 0, particles->capacity);
+        snapshot->y = growAlignedFloats(snapshot->y, 0, particles->capacity);
+        snapshot->capacity = particles->capacity;
+    }
+    memcpy(snapshot->x, particles->x, particles->length * sizeof(float));
+    memcpy(snapshot->y, particles->y, particles->length * sizeof(float));
+    snapshot->length = particles->length;
+}
+
+// Fills the render side copy, pos is blended between the snapshot (alpha 0) and the current
+// state (alpha 1) and prev_pos keeps the snapshot one
+void copyParticlesToAoS(ParticleSoA* particles, ParticleSnapshot* snapshot, float alpha, Vector_Particle* out) {
+    while(out->length < particles->length) {
+        append_vector_Particle(out, (Particle){0});
+    }
+    out->length = particles->length;
+
+    for(int i = 0; i < particles->length; i++) {
+        Particle* p = &out->data[i];
+        float2 cur = {particles->x[i], particles->y[i]};
+        // Particles spawned after the snapshot have nothing to blend from
+        float2 prev = i < snapshot->length ? (float2){snapshot->x[i], snapshot->y[i]} : cur;
+
+        p->prev_pos = prev;
+        p->pos = (float2){prev.x + (cur.x - prev.x) * alpha, prev.y + (cur.y - prev.y) * alpha};
+        p->vel = (float2){particles->vx[i], particles->vy[i]};
+        p->Static = isParticleStatic(particles, i);
+    }
+}
+
+void resolveCircleCollisionParticles(ParticleSoA* particles, int a, int b) {
+    float dx = particles->x[b] - particles->x[a];
+    float dy = particles->y[b] - particles->y[a];
+    float dist = sqrtf(dx*dx + dy*dy);
     float penetration = (2 * defaultParticleCircle.r) - dist;
     if(penetration > 0 && dist > 1e-6f) {
-        float2 normal = float2_mul(delta, 1.0f / dist);
-        float2 correction = float2_mul(normal, penetration * 0.5f);
+        float correction = penetration * 0.5f / dist;
+        float cx = dx * correction;
+        float cy = dy * correction;
+
+        if(!isParticleStatic(particles, a)) { particles->x[a] -= cx; particles->y[a] -= cy; }
+        if(!isParticleStatic(particles, b)) { particles->x[b] += cx; particles->y[b] += cy; }
+    }
+}
+
+/* Spatial grid (broadphase) */
+
+void initParticleGrid(ParticleGrid* grid, float cellSize, Rectangle box) {
+    grid->cellSize = cellSize;
+    grid->origin = box.pos;
+    grid->cols = (int)ceilf(box.size.x / cellSize);
+    grid->rows = (int)ceilf(box.size.y / cellSize);
+
+    grid->cellStart = calloc(grid->cols * grid->rows + 1, sizeof(int));
+    assert(grid->cellStart && "calloc failed");
 
-        if(!a->Static) a->pos = float2_sub(a->pos, correction);
-        if(!b->Static) b->pos = float2_add(b->pos, correction);
+    grid->cellParticles = NULL;
+    grid->particleCell = NULL;
+    grid->workerCounts = NULL;
+    grid->workers = 0;
+    grid->capacity = 0;
+}
+
+void freeParticleGrid(ParticleGrid* grid) {
+    free(grid->cellStart);
+    free(grid->cellParticles);
+    free(grid->particleCell);
+    free(grid->workerCounts);
+    grid->cellStart = NULL;
+    grid->cellParticles = NULL;
+    grid->particleCell = NULL;
+    grid->workerCounts = NULL;
+    grid->workers = 0;
+    grid->capacity = 0;
+}
+
+// Particles outside the box (before the wall pass) go to the border cells
+int gridCellCoord(float v, float origin, float cellSize, int cells) {
+    int c = (int)((v - origin) / cellSize);
+    if(c < 0) return 0;
+    if(c >= cells) return cells - 1;
+    return c;
+}
+
+int gridCellOf(ParticleGrid* grid, float x, float y) {
+    int cx = gridCellCoord(x, grid->origin.x, grid->cellSize, grid->cols);
+    int cy = gridCellCoord(y, grid->origin.y, grid->cellSize, grid->rows);
+    return cy * grid->cols + cx;
+}
 
+typedef struct GridJob {
+    ParticleGrid* grid;
+    ParticleSoA* particles;
+    int color;
+} GridJob;
+
+void countParticleCellsJob(void* ctx, int begin, int end, int worker) {
+    GridJob* job = ctx;
+    ParticleGrid* grid = job->grid;
+    int* counts = grid->workerCounts + (size_t)worker * grid->cols * grid->rows;
+
+    memset(counts, 0, grid->cols * grid->rows * sizeof(int));
+    for(int i = begin; i < end; i++) {
+        int c = gridCellOf(grid, job->particles->x[i], job->particles->y[i]);
+        grid->particleCell[i] = c;
+        counts[c]++;
+    }
+}
+
+void scatterParticleCellsJob(void* ctx, int begin, int end, int worker) {
+    GridJob* job = ctx;
+    ParticleGrid* grid = job->grid;
+    int* cursor = grid->workerCounts + (size_t)worker * grid->cols * grid->rows;
+
+    for(int i = begin; i < end; i++) {
+        grid->cellParticles[cursor[grid->particleCell[i]]++] = i;
+    }
+}
+
+// Counting sort of the particle indices by cell, rebuilt every step
+// Every worker counts and scatters its own slice of particles, so the order inside a cell
+// is still the particle order no matter how many threads there are
+void buildParticleGrid(ParticleGrid* grid, ParticleSoA* particles) {
+    int cellCount = grid->cols * grid->rows;
+
+    if(particles->length > grid->capacity) {
+        int* p1 = realloc(grid->cellParticles, particles->length * sizeof(int));
+        int* p2 = realloc(grid->particleCell, particles->length * sizeof(int));
+        assert(p1 && p2 && "realloc failed");
+        grid->cellParticles = p1;
+        grid->particleCell = p2;
+        grid->capacity = particles->length;
+    }
+
+    if(grid->workers != threadPool.count) {
+        int* p = realloc(grid->workerCounts, (size_t)threadPool.count * cellCount * sizeof(int));
+        assert(p && "realloc failed");
+        grid->workerCounts = p;
+        grid->workers = threadPool.count;
+    }
+
+    // Workers without particles don't clear their histogram
+    memset(grid->workerCounts, 0, (size_t)grid->workers * cellCount * sizeof(int));
+
+    GridJob job = {grid, particles, 0};
+
+    // Count
+    parallelFor(&threadPool, particles->length, countParticleCellsJob, &job);
+
+    // Prefix sum over (cell, worker), the counts turn into each worker's write cursor
+    int offset = 0;
+    for(int c = 0; c < cellCount; c++) {
+        grid->cellStart[c] = offset;
+        for(int w = 0; w < grid->workers; w++) {
+            int* count = &grid->workerCounts[(size_t)w * cellCount + c];
+            int n = *count;
+            *count = offset;
+            offset += n;
+        }
+    }
+    grid->cellStart[cellCount] = offset;
+
+    // Scatter
+    parallelFor(&threadPool, particles->length, scatterParticleCellsJob, &job);
+}
+
+void resolveParticleCollisionsRow(ParticleGrid* grid, ParticleSoA* particles, int cy) {
+    for(int cx = 0; cx < grid->cols; cx++) {
+        int cell = cy * grid->cols + cx;
+
+        for(int a = grid->cellStart[cell]; a < grid->cellStart[cell + 1]; a++) {
+            int i = grid->cellParticles[a];
+
+            for(int ny = cy - 1; ny <= cy + 1; ny++) {
+                if(ny < 0 || ny >= grid->rows) continue;
+                for(int nx = cx - 1; nx <= cx + 1; nx++) {
+                    if(nx < 0 || nx >= grid->cols) continue;
+                    int n_cell = ny * grid->cols + nx;
+
+                    for(int b = grid->cellStart[n_cell]; b < grid->cellStart[n_cell + 1]; b++) {
+                        int j = grid->cellParticles[b];
+                        if(j <= i) continue;
+                        resolveCircleCollisionParticles(particles, i, j);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void resolveParticleCollisionsJob(void* ctx, int begin, int end, int worker) {
+    GridJob* job = ctx;
+    for(int r = begin; r < end; r++) {
+        resolveParticleCollisionsRow(job->grid, job->particles, job->color + 3 * r);
+    }
+}
+
+// Only tests the 3x3 cells around each particle, every pair once (i < j)
+// A row only moves particles of its own and the two next to it, so the rows are split
+// in 3 colors (cy % 3) and all the rows of one color run at the same time
+void resolveParticleCollisionsGrid(ParticleGrid* grid, ParticleSoA* particles) {
+    for(int color = 0; color < 3; color++) {
+        GridJob job = {grid, particles, color};
+        int rows = (grid->rows - color + 2) / 3;
+        parallelFor(&threadPool, rows, resolveParticleCollisionsJob, &job);
     }
 }
 
@@ -513,35 +1131,56 @@ void resolveWorldBoxCollisions(Vector_PhysicBody* bodies) {
     }
 }
 
-void resolveWorldBoxCollisionsParticles(Vector_Particle* particles) {
-    for(int i = 0; i < particles->length; i++) {
-        Circle circ_ = defaultParticleCircle;
-        circ_.pos = particles->data[i].pos;
-        Circle* circ = &circ_;
+// The SIMD passes are split in blocks of 32 particles, one word of the static mask
 
-        if(!checkAABBCircAllInRect(*circ, screenBox)) {
-            // Left wall
-            if(circ->pos.x - circ->r < screenBox.pos.x) {
-                circ->pos.x = screenBox.pos.x + circ->r;
-                particles->data[i].vel.x *= -0.7f;
-            }
-            // Right wall
-            if(circ->pos.x + circ->r > screenBox.pos.x + screenBox.size.x) {
-                circ->pos.x = screenBox.pos.x + screenBox.size.x - circ->r;
-                particles->data[i].vel.x *= -0.7f;
-            }
-            // Top wall
-            if(circ->pos.y - circ->r < screenBox.pos.y) {
-                circ->pos.y = screenBox.pos.y + circ->r;
-                particles->data[i].vel.y *= -0.7f;
-            }
-            // Bottom wall
-            if(circ->pos.y + circ->r > screenBox.pos.y + screenBox.size.y) {
-                circ->pos.y = screenBox.pos.y + screenBox.size.y - circ->r;
-                particles->data[i].vel.y *= -0.7f;
-            }
-        }
-    }
+typedef struct IntegrateJob {
+    ParticleSoA* particles;
+    float2 acc;
+    float deltaTime;
+} IntegrateJob;
+
+void integrateParticlesJob(void* ctx, int begin, int end, int worker) {
+    IntegrateJob* job = ctx;
+    ParticleSoA* p = job->particles;
+    size_t first = (size_t)begin * 32;
+    size_t last = (size_t)end * 32 < p->length ? (size_t)end * 32 : p->length;
+
+    integrateParticlesKernel(p->x + first, p->y + first, p->vx + first, p->vy + first, p->staticMask + begin,
+                             last - first, job->acc.x, job->acc.y, job->deltaTime);
+}
+
+void integrateParticles(ParticleSoA* particles, float2 acc, float deltaTime) {
+    IntegrateJob job = {particles, acc, deltaTime};
+    parallelFor(&threadPool, (particles->length + 31) / 32, integrateParticlesJob, &job);
+}
+
+typedef struct ClampJob {
+    ParticleSoA* particles;
+    float minX;
+    float maxX;
+    float minY;
+    float maxY;
+} ClampJob;
+
+void clampParticlesJob(void* ctx, int begin, int end, int worker) {
+    ClampJob* job = ctx;
+    ParticleSoA* p = job->particles;
+    size_t first = (size_t)begin * 32;
+    size_t last = (size_t)end * 32 < p->length ? (size_t)end * 32 : p->length;
+
+    clampParticlesKernel(p->x + first, p->y + first, p->vx + first, p->vy + first, last - first,
+                         job->minX, job->maxX, job->minY, job->maxY, 0.7f);
+}
+
+void resolveWorldBoxCollisionsParticles(ParticleSoA* particles) {
+    float r = defaultParticleCircle.r;
+    float minX = screenBox.pos.x + r;
+    float maxX = screenBox.pos.x + screenBox.size.x - r;
+    float minY = screenBox.pos.y + r;
+    float maxY = screenBox.pos.y + screenBox.size.y - r;
+
+    ClampJob job = {particles, minX, maxX, minY, maxY};
+    parallelFor(&threadPool, (particles->length + 31) / 32, clampParticlesJob, &job);
 }
 
 void updateBodiesPosition(Vector_PhysicBody* bodies, double deltaTime, EngineSettings* engineSettings) {
@@ -593,58 +1232,732 @@ void updateBodiesPosition(Vector_PhysicBody* bodies, double deltaTime, EngineSet
 }
 
 
-void updateParticlesPosition(Vector_Particle* particles, float deltaTime, EngineSettings* engineSettings) {
-    Vector_float2 accelerations;
-    init_vector_float2(&accelerations);
+void updateParticlesPosition(ParticleSoA* particles, float deltaTime, EngineSettings* engineSettings) {
+    // Apply downward gravity to all non-static particles and update positions and velocities
+    float2 acc = engineSettings->enableWorldBoxGravity ? gravity_acc : (float2){0.0f, 0.0f};
+    double t = beginPhase();
+    integrateParticles(particles, acc, deltaTime);
+    endPhase(PHASE_INTEGRATE, t);
+
+    // Collision detection and resolution
+    if(engineSettings->enableCollisions) {
+        t = beginPhase();
+        buildParticleGrid(&particleGrid, particles);
+        endPhase(PHASE_GRID, t);
+
+        t = beginPhase();
+        resolveParticleCollisionsGrid(&particleGrid, particles);
+        endPhase(PHASE_COLLISIONS, t);
+    }
+
+    // World box collision
+    if(engineSettings->enableWorldBoxPhysicsBox) {
+        t = beginPhase();
+        resolveWorldBoxCollisionsParticles(particles);
+        endPhase(PHASE_WORLD_BOX, t);
+    }
+}
+
+/* SPH */
+
+void initNeighbourList(NeighbourList* list) {
+    list->start = NULL;
+    list->indices = NULL;
+    list->dist = NULL;
+    list->count = 0;
+    list->capacity = 0;
+    list->particleCapacity = 0;
+}
+
+void freeNeighbourList(NeighbourList* list) {
+    free(list->start);
+    free(list->indices);
+    free(list->dist);
+    initNeighbourList(list);
+}
+
+void appendNeighbour(NeighbourList* list, int j, float dist) {
+    if(list->count >= list->capacity) {
+        size_t new_cap = list->capacity ? list->capacity * 2 : 1024;
+        int* p1 = realloc(list->indices, new_cap * sizeof(int));
+        float* p2 = realloc(list->dist, new_cap * sizeof(float));
+        assert(p1 && p2 && "realloc failed");
+        list->indices = p1;
+        list->dist = p2;
+        list->capacity = new_cap;
+    }
+    list->indices[list->count] = j;
+    list->dist[list->count] = dist;
+    list->count++;
+}
+
+// The grid has to be built with a cell size >= radius so 3x3 cells cover it
+void buildNeighbourList(NeighbourList* list, ParticleGrid* grid, ParticleSoA* particles, float radius) {
+    if(particles->length + 1 > list->particleCapacity) {
+        int* p = realloc(list->start, (particles->length + 1) * sizeof(int));
+        assert(p && "realloc failed");
+        list->start = p;
+        list->particleCapacity = particles->length + 1;
+    }
+
+    float radiusSqr = radius * radius;
+    list->count = 0;
 
     for(int i = 0; i < particles->length; i++) {
-        append_vector_float2(&accelerations, (float2){0,0});
+        list->start[i] = list->count;
+
+        float x = particles->x[i];
+        float y = particles->y[i];
+        int cell = grid->particleCell[i];
+        int cx = cell % grid->cols;
+        int cy = cell / grid->cols;
+
+        for(int ny = cy - 1; ny <= cy + 1; ny++) {
+            if(ny < 0 || ny >= grid->rows) continue;
+            for(int nx = cx - 1; nx <= cx + 1; nx++) {
+                if(nx < 0 || nx >= grid->cols) continue;
+                int n_cell = ny * grid->cols + nx;
+
+                for(int b = grid->cellStart[n_cell]; b < grid->cellStart[n_cell + 1]; b++) {
+                    int j = grid->cellParticles[b];
+                    if(j == i) continue;
+
+                    float dx = particles->x[j] - x;
+                    float dy = particles->y[j] - y;
+                    float distSqr = dx*dx + dy*dy;
+                    if(distSqr < radiusSqr) {
+                        appendNeighbour(list, j, sqrtf(distSqr));
+                    }
+                }
+            }
+        }
     }
+    list->start[particles->length] = list->count;
+}
 
-    // Apply downward gravity to all non-static bodies
-    if(engineSettings->enableWorldBoxGravity) {
-        for(int i = 0; i < particles->length; i++) {
-            if(particles->data[i].Static) continue;
-            accelerations.data[i] = float2_add(accelerations.data[i], gravity_acc);
+void initSPHBuffers(SPHBuffers* buffers) {
+    buffers->density = NULL;
+    buffers->pressure = NULL;
+    buffers->acc = NULL;
+    buffers->capacity = 0;
+}
+
+void freeSPHBuffers(SPHBuffers* buffers) {
+    free(buffers->density);
+    free(buffers->pressure);
+    free(buffers->acc);
+    initSPHBuffers(buffers);
+}
+
+void reserveSPHBuffers(SPHBuffers* buffers, size_t count) {
+    if(count <= buffers->capacity) return;
+
+    float* p1 = realloc(buffers->density, count * sizeof(float));
+    float* p2 = realloc(buffers->pressure, count * sizeof(float));
+    float2* p3 = realloc(buffers->acc, count * sizeof(float2));
+    assert(p1 && p2 && p3 && "realloc failed");
+
+    buffers->density = p1;
+    buffers->pressure = p2;
+    buffers->acc = p3;
+    buffers->capacity = count;
+}
+
+// 2D kernels from Muller et al. 2003: poly6 for density, spiky gradient for pressure
+// and the viscosity laplacian
+void computeDensityPressure(ParticleSoA* particles, NeighbourList* list, SPHBuffers* buffers, SPHSettings* sph) {
+    float hSqr = sph->h * sph->h;
+    float poly6 = 4.0f / (M_PI * powf(sph->h, 8.0f));
+    float selfDensity = sph->mass * poly6 * hSqr * hSqr * hSqr;
+
+    for(int i = 0; i < particles->length; i++) {
+        float density = selfDensity;
+        for(int n = list->start[i]; n < list->start[i + 1]; n++) {
+            float r = list->dist[n];
+            float d = hSqr - r*r;
+            density += sph->mass * poly6 * d*d*d;
+        }
+        buffers->density[i] = density;
+        buffers->pressure[i] = sph->gasConstant * (density - sph->restDensity);
+    }
+}
+
+void computeSPHAccelerations(ParticleSoA* particles, NeighbourList* list, SPHBuffers* buffers, SPHSettings* sph, EngineSettings* engineSettings) {
+    float spikyGrad = -30.0f / (M_PI * powf(sph->h, 5.0f));
+    float viscLap = 40.0f / (M_PI * powf(sph->h, 5.0f));
+
+    for(int i = 0; i < particles->length; i++) {
+        float2 pressureForce = {0.0f, 0.0f};
+        float2 viscosityForce = {0.0f, 0.0f};
+
+        for(int n = list->start[i]; n < list->start[i + 1]; n++) {
+            int j = list->indices[n];
+            float r = list->dist[n];
+            if(r < 1e-6f) continue;
+
+            float2 dir = {(particles->x[j] - particles->x[i]) / r, (particles->y[j] - particles->y[i]) / r};
+            float2 dv = {particles->vx[j] - particles->vx[i], particles->vy[j] - particles->vy[i]};
+            float hr = sph->h - r;
+
+            float pressureMag = sph->mass * (buffers->pressure[i] + buffers->pressure[j]) / (2.0f * buffers->density[j]) * spikyGrad * hr*hr;
+            pressureForce = float2_add(pressureForce, float2_mul(dir, pressureMag));
+
+            float viscosityMag = sph->viscosity * sph->mass / buffers->density[j] * viscLap * hr;
+            viscosityForce = float2_add(viscosityForce, float2_mul(dv, viscosityMag));
+        }
+
+        // Forces are per volume, so divide by the density to get the acceleration
+        float2 acc = float2_mul(float2_add(pressureForce, viscosityForce), 1.0f / buffers->density[i]);
+        if(engineSettings->enableWorldBoxGravity) {
+            acc = float2_add(acc, gravity_acc);
         }
+        buffers->acc[i] = acc;
     }
+}
 
-    // Update positions and velocities
+void stepParticlesSPH(ParticleSoA* particles, float deltaTime, EngineSettings* engineSettings) {
+    SPHSettings* sph = &engineSettings->sph;
+
+    reserveSPHBuffers(&sphBuffers, particles->length);
+
+    // One neighbour search, reused by the density and the force passes
+    double t = beginPhase();
+    buildParticleGrid(&fluidGrid, particles);
+    endPhase(PHASE_GRID, t);
+
+    t = beginPhase();
+    buildNeighbourList(&neighbourList, &fluidGrid, particles, sph->h);
+    endPhase(PHASE_NEIGHBOURS, t);
+
+    t = beginPhase();
+    computeDensityPressure(particles, &neighbourList, &sphBuffers, sph);
+    endPhase(PHASE_DENSITY, t);
+
+    t = beginPhase();
+    computeSPHAccelerations(particles, &neighbourList, &sphBuffers, sph, engineSettings);
+    endPhase(PHASE_FORCES, t);
+
+    t = beginPhase();
     for(int i = 0; i < particles->length; i++) {
-        if(particles->data[i].Static) continue;
+        if(isParticleStatic(particles, i)) continue;
 
-        particles->data[i].vel = float2_add(particles->data[i].vel, float2_mul(accelerations.data[i], deltaTime));
+        particles->vx[i] += sphBuffers.acc[i].x * deltaTime;
+        particles->vy[i] += sphBuffers.acc[i].y * deltaTime;
+        particles->x[i] += particles->vx[i] * deltaTime;
+        particles->y[i] += particles->vy[i] * deltaTime;
+    }
+    endPhase(PHASE_INTEGRATE, t);
 
-        float2 newPos = float2_add(particles->data[i].pos, float2_mul(particles->data[i].vel, deltaTime));
-        particles->data[i].pos = newPos;
+    if(engineSettings->enableWorldBoxPhysicsBox) {
+        t = beginPhase();
+        resolveWorldBoxCollisionsParticles(particles);
+        endPhase(PHASE_WORLD_BOX, t);
     }
+}
 
-    // Collision detection and resolution
-    if(engineSettings->enableCollisions) {
-        for(int i = 0; i < particles->length; i++) {
-            for(int j = i+1; j < particles->length; j++) {
-                resolveCircleCollisionParticles(&particles->data[i], &particles->data[j]);
-            }
+/* PBF */
+
+void initPBFBuffers(PBFBuffers* buffers) {
+    buffers->prevX = NULL;
+    buffers->prevY = NULL;
+    buffers->lambda = NULL;
+    buffers->delta = NULL;
+    buffers->capacity = 0;
+}
+
+void freePBFBuffers(PBFBuffers* buffers) {
+    free(buffers->prevX);
+    free(buffers->prevY);
+    free(buffers->lambda);
+    free(buffers->delta);
+    initPBFBuffers(buffers);
+}
+
+void reservePBFBuffers(PBFBuffers* buffers, size_t count) {
+    if(count <= buffers->capacity) return;
+
+    float* p1 = realloc(buffers->lambda, count * sizeof(float));
+    float2* p2 = realloc(buffers->delta, count * sizeof(float2));
+    float* p3 = realloc(buffers->prevX, count * sizeof(float));
+    float* p4 = realloc(buffers->prevY, count * sizeof(float));
+    assert(p1 && p2 && p3 && p4 && "realloc failed");
+
+    buffers->lambda = p1;
+    buffers->delta = p2;
+    buffers->prevX = p3;
+    buffers->prevY = p4;
+    buffers->capacity = count;
+}
+
+// lambda_i = -C_i / (sum |grad C_i|^2 + eps), with C_i = rho_i / rho0 - 1
+// The constraint is one sided (only pushes apart), so the free surface doesn't clump
+void computePBFLambdas(ParticleSoA* particles, NeighbourList* list, PBFBuffers* buffers, PBFSettings* pbf) {
+    float hSqr = pbf->h * pbf->h;
+    float poly6 = 4.0f / (M_PI * powf(pbf->h, 8.0f));
+    float spikyGrad = -30.0f / (M_PI * powf(pbf->h, 5.0f));
+    float selfDensity = poly6 * hSqr * hSqr * hSqr;
+
+    for(int i = 0; i < particles->length; i++) {
+        float density = selfDensity;
+        float2 gradI = {0.0f, 0.0f};
+        float sumGradSqr = 0.0f;
+
+        for(int n = list->start[i]; n < list->start[i + 1]; n++) {
+            int j = list->indices[n];
+            float2 d = {particles->x[i] - particles->x[j], particles->y[i] - particles->y[j]};
+            float rSqr = d.x*d.x + d.y*d.y;
+            if(rSqr >= hSqr) continue;
+
+            float w = hSqr - rSqr;
+            density += poly6 * w*w*w;
+
+            float r = sqrtf(rSqr);
+            if(r < 1e-6f) continue;
+
+            float hr = pbf->h - r;
+            float2 grad = float2_mul(d, spikyGrad * hr*hr / (r * pbf->restDensity));
+            gradI = float2_add(gradI, grad);
+            sumGradSqr += grad.x*grad.x + grad.y*grad.y;
         }
+        sumGradSqr += gradI.x*gradI.x + gradI.y*gradI.y;
+
+        float C = fmaxf(density / pbf->restDensity - 1.0f, 0.0f);
+        buffers->lambda[i] = -C / (sumGradSqr + pbf->relaxation);
     }
+}
 
-    // World box collision
+void computePBFDeltas(ParticleSoA* particles, NeighbourList* list, PBFBuffers* buffers, PBFSettings* pbf) {
+    float hSqr = pbf->h * pbf->h;
+    float poly6 = 4.0f / (M_PI * powf(pbf->h, 8.0f));
+    float spikyGrad = -30.0f / (M_PI * powf(pbf->h, 5.0f));
+
+    // s_corr = -k * (W(r) / W(0.2h))^4
+    float dq = hSqr - 0.04f * hSqr;
+    float wDq = poly6 * dq*dq*dq;
+
+    for(int i = 0; i < particles->length; i++) {
+        float2 delta = {0.0f, 0.0f};
+
+        for(int n = list->start[i]; n < list->start[i + 1]; n++) {
+            int j = list->indices[n];
+            float2 d = {particles->x[i] - particles->x[j], particles->y[i] - particles->y[j]};
+            float rSqr = d.x*d.x + d.y*d.y;
+            if(rSqr >= hSqr) continue;
+
+            float r = sqrtf(rSqr);
+            if(r < 1e-6f) continue;
+
+            float w = hSqr - rSqr;
+            float ratio = poly6 * w*w*w / wDq;
+            float sCorr = -pbf->tensileK * ratio*ratio*ratio*ratio;
+
+            float hr = pbf->h - r;
+            float scale = (buffers->lambda[i] + buffers->lambda[j] + sCorr) * spikyGrad * hr*hr / r;
+            delta = float2_add(delta, float2_mul(d, scale));
+        }
+
+        buffers->delta[i] = float2_mul(delta, 1.0f / pbf->restDensity);
+    }
+}
+
+void applyXSPHViscosity(ParticleSoA* particles, NeighbourList* list, PBFBuffers* buffers, PBFSettings* pbf) {
+    float hSqr = pbf->h * pbf->h;
+    float poly6 = 4.0f / (M_PI * powf(pbf->h, 8.0f));
+
+    for(int i = 0; i < particles->length; i++) {
+        float2 smoothing = {0.0f, 0.0f};
+
+        for(int n = list->start[i]; n < list->start[i + 1]; n++) {
+            int j = list->indices[n];
+            float dx = particles->x[i] - particles->x[j];
+            float dy = particles->y[i] - particles->y[j];
+            float rSqr = dx*dx + dy*dy;
+            if(rSqr >= hSqr) continue;
+
+            float w = hSqr - rSqr;
+            float2 dv = {particles->vx[j] - particles->vx[i], particles->vy[j] - particles->vy[i]};
+            smoothing = float2_add(smoothing, float2_mul(dv, poly6 * w*w*w));
+        }
+
+        float k = pbf->viscosity / pbf->restDensity;
+        buffers->delta[i] = (float2){particles->vx[i] + smoothing.x * k, particles->vy[i] + smoothing.y * k};
+    }
+
+    for(int i = 0; i < particles->length; i++) {
+        if(isParticleStatic(particles, i)) continue;
+        particles->vx[i] = buffers->delta[i].x;
+        particles->vy[i] = buffers->delta[i].y;
+    }
+}
+
+// prevX/prevY keep the position at the start of the step and x/y is the prediction the
+// constraints work on, the new velocity is the difference of both
+void stepParticlesPBF(ParticleSoA* particles, float deltaTime, EngineSettings* engineSettings) {
+    PBFSettings* pbf = &engineSettings->pbf;
+
+    reservePBFBuffers(&pbfBuffers, particles->length);
+
+    // Predict positions
+    double t = beginPhase();
+    memcpy(pbfBuffers.prevX, particles->x, particles->length * sizeof(float));
+    memcpy(pbfBuffers.prevY, particles->y, particles->length * sizeof(float));
+
+    float2 acc = engineSettings->enableWorldBoxGravity ? gravity_acc : (float2){0.0f, 0.0f};
+    integrateParticles(particles, acc, deltaTime);
+    endPhase(PHASE_INTEGRATE, t);
+
+    // The wall bounce on the velocity doesn't matter here, it gets rebuilt from the positions
     if(engineSettings->enableWorldBoxPhysicsBox) {
+        t = beginPhase();
         resolveWorldBoxCollisionsParticles(particles);
+        endPhase(PHASE_WORLD_BOX, t);
     }
 
-    free_vector_float2(&accelerations);
+    // One neighbour search on the predicted positions, reused by every iteration
+    t = beginPhase();
+    buildParticleGrid(&fluidGrid, particles);
+    endPhase(PHASE_GRID, t);
+
+    t = beginPhase();
+    buildNeighbourList(&neighbourList, &fluidGrid, particles, pbf->h);
+    endPhase(PHASE_NEIGHBOURS, t);
+
+    // The wall clamps between iterations count as constraints too
+    t = beginPhase();
+    for(int it = 0; it < pbf->iterations; it++) {
+        computePBFLambdas(particles, &neighbourList, &pbfBuffers, pbf);
+        computePBFDeltas(particles, &neighbourList, &pbfBuffers, pbf);
+
+        for(int i = 0; i < particles->length; i++) {
+            if(isParticleStatic(particles, i)) continue;
+            particles->x[i] += pbfBuffers.delta[i].x;
+            particles->y[i] += pbfBuffers.delta[i].y;
+        }
+
+        if(engineSettings->enableWorldBoxPhysicsBox) {
+            resolveWorldBoxCollisionsParticles(particles);
+        }
+    }
+    endPhase(PHASE_CONSTRAINTS, t);
+
+    // Update velocities
+    t = beginPhase();
+    for(int i = 0; i < particles->length; i++) {
+        if(isParticleStatic(particles, i)) continue;
+        particles->vx[i] = (particles->x[i] - pbfBuffers.prevX[i]) / deltaTime;
+        particles->vy[i] = (particles->y[i] - pbfBuffers.prevY[i]) / deltaTime;
+    }
+    endPhase(PHASE_INTEGRATE, t);
+
+    t = beginPhase();
+    applyXSPHViscosity(particles, &neighbourList, &pbfBuffers, pbf);
+    endPhase(PHASE_VISCOSITY, t);
+}
+
+/* Reordering */
+
+void initParticleReorder(ParticleReorder* reorder) {
+    reorder->keys = NULL;
+    reorder->order = NULL;
+    reorder->tmpKeys = NULL;
+    reorder->tmpOrder = NULL;
+    reorder->scratch = NULL;
+    reorder->scratchMask = NULL;
+    reorder->workerCounts = NULL;
+    reorder->workers = 0;
+    reorder->capacity = 0;
+    reorder->stepsSinceSort = 0;
+    reorder->sorts = 0;
+}
+
+void freeParticleReorder(ParticleReorder* reorder) {
+    free(reorder->keys);
+    free(reorder->order);
+    free(reorder->tmpKeys);
+    free(reorder->tmpOrder);
+    aligned_free(reorder->scratch);
+    free(reorder->scratchMask);
+    free(reorder->workerCounts);
+    initParticleReorder(reorder);
+}
+
+// Sized to the particle capacity, the scratch array gets swapped with the particle arrays
+void reserveParticleReorder(ParticleReorder* reorder, ParticleSoA* particles) {
+    if(reorder->workers != threadPool.count) {
+        int* p = realloc(reorder->workerCounts, (size_t)threadPool.count * 256 * sizeof(int));
+        assert(p && "realloc failed");
+        reorder->workerCounts = p;
+        reorder->workers = threadPool.count;
+    }
+
+    if(particles->capacity <= reorder->capacity) return;
+
+    size_t capacity = particles->capacity;
+    free(reorder->keys);
+    free(reorder->order);
+    free(reorder->tmpKeys);
+    free(reorder->tmpOrder);
+    free(reorder->scratchMask);
+    reorder->keys = malloc(capacity * sizeof(uint32_t));
+    reorder->order = malloc(capacity * sizeof(uint32_t));
+    reorder->tmpKeys = malloc(capacity * sizeof(uint32_t));
+    reorder->tmpOrder = malloc(capacity * sizeof(uint32_t));
+    reorder->scratchMask = malloc((capacity + 31) / 32 * sizeof(uint32_t));
+    assert(reorder->keys && reorder->order && reorder->tmpKeys && reorder->tmpOrder && reorder->scratchMask && "malloc failed");
+    reorder->scratch = growAlignedFloats(reorder->scratch, 0, capacity);
+    reorder->capacity = capacity;
+}
+
+// Spreads the low 16 bits of v to the even bits
+uint32_t mortonSpread(uint32_t v) {
+    v &= 0xFFFF;
+    v = (v | (v << 8)) & 0x00FF00FF;
+    v = (v | (v << 4)) & 0x0F0F0F0F;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+uint32_t mortonCode(int cx, int cy) {
+    return mortonSpread(cx) | (mortonSpread(cy) << 1);
+}
+
+// Fraction of the consecutive particles of a cell that are more than a cache line apart in
+// the arrays, close to 0 right after a sort and it grows as the particles mix
+float gridLocalityMissRate(ParticleGrid* grid, ParticleSoA* particles) {
+    int cellCount = grid->cols * grid->rows;
+    // The grid isn't built for this particle set yet
+    if(grid->capacity < particles->length || grid->cellStart[cellCount] != particles->length) return 0.0f;
+
+    int pairs = 0;
+    int misses = 0;
+    for(int c = 0; c < cellCount; c++) {
+        for(int k = grid->cellStart[c] + 1; k < grid->cellStart[c + 1]; k++) {
+            int d = grid->cellParticles[k] - grid->cellParticles[k - 1];
+            if(d < 0) d = -d;
+            if(d > 16) misses++;
+            pairs++;
+        }
+    }
+    return pairs ? (float)misses / pairs : 0.0f;
+}
+
+typedef struct ReorderJob {
+    ParticleReorder* reorder;
+    ParticleGrid* grid;
+    ParticleSoA* particles;
+    const uint32_t* srcKeys;
+    const uint32_t* srcOrder;
+    uint32_t* dstKeys;
+    uint32_t* dstOrder;
+    int shift;
+    const float* src;
+    float* dst;
+} ReorderJob;
+
+void mortonKeysJob(void* ctx, int begin, int end, int worker) {
+    ReorderJob* job = ctx;
+    ParticleGrid* grid = job->grid;
+    for(int i = begin; i < end; i++) {
+        int cx = gridCellCoord(job->particles->x[i], grid->origin.x, grid->cellSize, grid->cols);
+        int cy = gridCellCoord(job->particles->y[i], grid->origin.y, grid->cellSize, grid->rows);
+        job->reorder->keys[i] = mortonCode(cx, cy);
+        job->reorder->order[i] = i;
+    }
+}
+
+void radixCountJob(void* ctx, int begin, int end, int worker) {
+    ReorderJob* job = ctx;
+    int* counts = job->reorder->workerCounts + worker * 256;
+    for(int i = begin; i < end; i++) {
+        counts[(job->srcKeys[i] >> job->shift) & 0xFF]++;
+    }
+}
+
+void radixScatterJob(void* ctx, int begin, int end, int worker) {
+    ReorderJob* job = ctx;
+    int* cursor = job->reorder->workerCounts + worker * 256;
+    for(int i = begin; i < end; i++) {
+        int dst = cursor[(job->srcKeys[i] >> job->shift) & 0xFF]++;
+        job->dstKeys[dst] = job->srcKeys[i];
+        job->dstOrder[dst] = job->srcOrder[i];
+    }
+}
+
+void gatherFloatsJob(void* ctx, int begin, int end, int worker) {
+    ReorderJob* job = ctx;
+    const uint32_t* order = job->reorder->order;
+    for(int i = begin; i < end; i++) {
+        job->dst[i] = job->src[order[i]];
+    }
+}
+
+// One whole mask word per iteration so workers never share a word
+void gatherStaticMaskJob(void* ctx, int begin, int end, int worker) {
+    ReorderJob* job = ctx;
+    const uint32_t* order = job->reorder->order;
+    const uint32_t* mask = job->particles->staticMask;
+    for(int w = begin; w < end; w++) {
+        uint32_t bits = 0;
+        int last = (w + 1) * 32 < job->particles->length ? (w + 1) * 32 : job->particles->length;
+        for(int i = w * 32; i < last; i++) {
+            uint32_t src = order[i];
+            bits |= ((mask[src >> 5] >> (src & 31)) & 1) << (i & 31);
+        }
+        job->reorder->scratchMask[w] = bits;
+    }
+}
+
+// LSD radix sort of (keys, order), 8 bits per pass, only as many passes as the keys need
+// Workers count and scatter contiguous slices, so the sort is stable for any thread count
+void radixSortParticleKeys(ParticleReorder* reorder, int n, int keyBits) {
+    ReorderJob job = {reorder};
+
+    for(int shift = 0; shift < keyBits; shift += 8) {
+        job.srcKeys = reorder->keys;
+        job.srcOrder = reorder->order;
+        job.dstKeys = reorder->tmpKeys;
+        job.dstOrder = reorder->tmpOrder;
+        job.shift = shift;
+
+        memset(reorder->workerCounts, 0, (size_t)reorder->workers * 256 * sizeof(int));
+        parallelFor(&threadPool, n, radixCountJob, &job);
+
+        int offset = 0;
+        for(int d = 0; d < 256; d++) {
+            for(int w = 0; w < reorder->workers; w++) {
+                int* count = &reorder->workerCounts[w * 256 + d];
+                int c = *count;
+                *count = offset;
+                offset += c;
+            }
+        }
+
+        parallelFor(&threadPool, n, radixScatterJob, &job);
+
+        uint32_t* t = reorder->keys; reorder->keys = reorder->tmpKeys; reorder->tmpKeys = t;
+        t = reorder->order; reorder->order = reorder->tmpOrder; reorder->tmpOrder = t;
+    }
+}
+
+// Gathers a particle array through the new order and swaps it with the scratch one
+void permuteParticleArray(ParticleReorder* reorder, float** array, int n) {
+    ReorderJob job = {reorder};
+    job.src = *array;
+    job.dst = reorder->scratch;
+    parallelFor(&threadPool, n, gatherFloatsJob, &job);
+
+    float* t = *array;
+    *array = reorder->scratch;
+    reorder->scratch = t;
+}
+
+// Sorts the particles by the Morton code of their cell in grid
+// Everything indexed by particle that lives across steps is permuted with them, the
+// interpolation snapshot included. The solver buffers are rebuilt every step anyway
+void reorderParticles(ParticleReorder* reorder, ParticleGrid* grid, ParticleSoA* particles) {
+    int n = particles->length;
+    if(n < 2) return;
+
+    reserveParticleReorder(reorder, particles);
+
+    ReorderJob job = {reorder, grid, particles};
+    parallelFor(&threadPool, n, mortonKeysJob, &job);
+
+    int maxCell = grid->cols > grid->rows ? grid->cols : grid->rows;
+    int cellBits = 0;
+    while((1 << cellBits) < maxCell) cellBits++;
+    radixSortParticleKeys(reorder, n, 2 * cellBits);
+
+    permuteParticleArray(reorder, &particles->x, n);
+    permuteParticleArray(reorder, &particles->y, n);
+    permuteParticleArray(reorder, &particles->vx, n);
+    permuteParticleArray(reorder, &particles->vy, n);
+
+    parallelFor(&threadPool, (n + 31) / 32, gatherStaticMaskJob, &job);
+    memcpy(particles->staticMask, reorder->scratchMask, (n + 31) / 32 * sizeof(uint32_t));
+
+    if(previousState.length == n) {
+        job.src = previousState.x;
+        job.dst = reorder->scratch;
+        parallelFor(&threadPool, n, gatherFloatsJob, &job);
+        memcpy(previousState.x, reorder->scratch, n * sizeof(float));
+
+        job.src = previousState.y;
+        parallelFor(&threadPool, n, gatherFloatsJob, &job);
+        memcpy(previousState.y, reorder->scratch, n * sizeof(float));
+    }
+
+    reorder->stepsSinceSort = 0;
+    reorder->sorts++;
+}
+
+// Sorts on the fixed interval, or earlier when the grid of the last step shows the
+// particles have mixed too much
+void reorderParticlesIfNeeded(ParticleSoA* particles, EngineSettings* engineSettings) {
+    ReorderSettings* settings = &engineSettings->reorder;
+    if(settings->interval <= 0 && settings->missRate <= 0.0f) return;
+
+    ParticleGrid* grid = engineSettings->solver == SOLVER_IMPULSE ? &particleGrid : &fluidGrid;
+    particleReorder.stepsSinceSort++;
+
+    bool sort = settings->interval > 0 && particleReorder.stepsSinceSort >= settings->interval;
+    if(!sort && settings->missRate > 0.0f) {
+        sort = gridLocalityMissRate(grid, particles) > settings->missRate;
+    }
+    if(!sort) return;
+
+    double t = beginPhase();
+    reorderParticles(&particleReorder, grid, particles);
+    endPhase(PHASE_REORDER, t);
 }
 
 /* Main Functions */
-void updateScene(double deltaTime, Vector_Particle* particcles, EngineSettings* engineSettings) {
+void updateScene(double deltaTime, ParticleSoA* particcles, EngineSettings* engineSettings) {
 
     /*
     for(int i= 0 ; i < bodies->length; i++) {
         updateBodyPosition(&bodies->data[i], deltaTime);
     }
     */
-    updateParticlesPosition(particcles, deltaTime, engineSettings);
+    reorderParticlesIfNeeded(particcles, engineSettings);
+
+    switch(engineSettings->solver) {
+        case SOLVER_IMPULSE:
+            updateParticlesPosition(particcles, deltaTime, engineSettings);
+            break;
+        case SOLVER_SPH:
+            stepParticlesSPH(particcles, deltaTime, engineSettings);
+            break;
+        case SOLVER_PBF:
+            stepParticlesPBF(particcles, deltaTime, engineSettings);
+            break;
+    }
+}
+
+// Runs the fixed steps that fit in the accumulated time, returns how many ran
+// The snapshot is only taken before the last one, that's the only one rendering needs
+int advanceFixedTimestep(FixedTimestep* timestep, double frameTime, ParticleSoA* particles, EngineSettings* engineSettings) {
+    timestep->accumulator += frameTime;
+
+    int steps = (int)(timestep->accumulator / timestep->dt);
+    if(steps > timestep->maxStepsPerFrame) {
+        steps = timestep->maxStepsPerFrame;
+        timestep->accumulator = fmod(timestep->accumulator, timestep->dt) + steps * timestep->dt;
+    }
+
+    double substepDt = timestep->dt / timestep->substeps;
+    for(int s = 0; s < steps; s++) {
+        if(s == steps - 1) {
+            saveParticleSnapshot(&previousState, particles);
+        }
+        for(int i = 0; i < timestep->substeps; i++) {
+            updateScene(substepDt, particles, engineSettings);
+        }
+        timestep->accumulator -= timestep->dt;
+    }
+
+    return steps;
 }
 
 // Exmplae to make a trail for a body
@@ -656,7 +1969,8 @@ void renderScene(GLFWwindow* window, Vector_Particle* particles) {
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
 
-    triangleBuffer.count = 0;
+    beginTriangles();
+    circleBuffer.length = 0;
 
     // To update and render the trail, prob gonna change it too
     // updateTrail(&bodyTrail, bodies->data[0].circ.pos);
@@ -671,25 +1985,83 @@ void renderScene(GLFWwindow* window, Vector_Particle* particles) {
     // drawRectangle(a);
 
     sendTrianglesToGPU();
+    sendCirclesToGPU();
 
     glfwSwapBuffers(window);
 }
 
-void gameLoop(GLFWwindow* window, Vector_Particle* particles, EngineSettings* engineSettings) {
+void gameLoop(GLFWwindow* window, ParticleSoA* particles, Vector_Particle* renderParticles,
+              EngineSettings* engineSettings, FixedTimestep* timestep) {
     double lastTime = glfwGetTime();
 
+    saveParticleSnapshot(&previousState, particles);
+
     while (!glfwWindowShouldClose(window)) {
         double currentTime = glfwGetTime();
-        float deltaTime = (float)(currentTime - lastTime);
+        double frameTime = currentTime - lastTime;
         lastTime = currentTime;
 
         glfwPollEvents();
 
-        updateScene(deltaTime, particles, engineSettings);
-        renderScene(window, particles);
+        advanceFixedTimestep(timestep, frameTime, particles, engineSettings);
+
+        float alpha = (float)(timestep->accumulator / timestep->dt);
+        copyParticlesToAoS(particles, &previousState, alpha, renderParticles);
+        renderScene(window, renderParticles);
     }
 }
 
+// Hash of the final positions, summed per particle so a reorder doesn't change it
+// Two runs that only differ in --threads have to print the same one
+uint64_t particleChecksum(ParticleSoA* particles) {
+    uint64_t sum = 0;
+    for(size_t i = 0; i < particles->length; i++) {
+        uint32_t bx, by;
+        memcpy(&bx, &particles->x[i], sizeof(bx));
+        memcpy(&by, &particles->y[i], sizeof(by));
+        uint64_t h = ((uint64_t)bx << 32 | by) * 0x9E3779B97F4A7C15ULL;
+        sum += h ^ (h >> 29);
+    }
+    return sum;
+}
+
+// Runs steps fixed steps without a window and prints the timings as JSON on stdout
+void runHeadless(ParticleSoA* particles, EngineSettings* engineSettings, FixedTimestep* timestep,
+                 int steps, const char* kernels) {
+    memset(phaseTimes, 0, sizeof(phaseTimes));
+
+    double substepDt = timestep->dt / timestep->substeps;
+    double start = get_time_seconds();
+    for(int s = 0; s < steps; s++) {
+        for(int i = 0; i < timestep->substeps; i++) {
+            updateScene(substepDt, particles, engineSettings);
+        }
+    }
+    double wallTime = get_time_seconds() - start;
+
+    printf("{\n");
+    printf("  \"solver\": \"%s\",\n", solverNames[engineSettings->solver]);
+    printf("  \"particles\": %zu,\n", particles->length);
+    printf("  \"particle_collisions\": %s,\n", engineSettings->enableCollisions ? "true" : "false");
+    printf("  \"seed\": %llu,\n", (unsigned long long)rng_get_seed());
+    printf("  \"steps\": %d,\n", steps);
+    printf("  \"substeps\": %d,\n", timestep->substeps);
+    printf("  \"dt\": %g,\n", timestep->dt);
+    printf("  \"threads\": %d,\n", threadPool.count);
+    printf("  \"kernels\": \"%s\",\n", kernels);
+    printf("  \"wall_time_s\": %.6f,\n", wallTime);
+    printf("  \"steps_per_sec\": %.3f,\n", steps / wallTime);
+    printf("  \"particle_steps_per_sec\": %.1f,\n", (double)steps * particles->length / wallTime);
+    printf("  \"reorders\": %d,\n", particleReorder.sorts);
+    printf("  \"checksum\": \"%016llx\",\n", (unsigned long long)particleChecksum(particles));
+    printf("  \"phases_s\": {\n");
+    for(int p = 0; p < PHASE_COUNT; p++) {
+        printf("    \"%s\": %.6f%s\n", phaseNames[p], phaseTimes[p], p + 1 < PHASE_COUNT ? "," : "");
+    }
+    printf("  }\n");
+    printf("}\n");
+}
+
 bool contains_float2(Vector_float2* v, float2 f) {
     for(int i = 0; i < v->length; i++) {
         if(v->data[i].x == f.x && v->data[i].y == f.y) { return true; }
@@ -697,21 +2069,33 @@ bool contains_float2(Vector_float2* v, float2 f) {
     return false;
 }
 
-void generateParticles(Vector_Particle* particles, int count) {
+void generateParticles(ParticleSoA* particles, int count) {
     Vector_float2 prev_pos;
     init_vector_float2(&prev_pos);
 
+    Rng* rng = rng_local();
+    float r = defaultParticleCircle.r;
+    float2 spawnMin = {r, r};
+    float2 spawnSize = {WIDTH - 2.0f * r, HEIGHT - 2.0f * r};
+
+    // Every position up front in two bulk calls, already inside the screen so the retry below is rare
+    float* xs = malloc(sizeof(float) * count);
+    float* ys = malloc(sizeof(float) * count);
+    assert(xs && ys && "malloc failed");
+    rng_floats(rng, xs, count, spawnMin.x, spawnMin.x + spawnSize.x);
+    rng_floats(rng, ys, count, spawnMin.y, spawnMin.y + spawnSize.y);
+
     for(int i = 0; i < count; i++) {
         Particle new_particle;
 
-        float2 pos = { (float)(rand() % WIDTH), (float)(rand() % HEIGHT)};
+        float2 pos = {xs[i], ys[i]};
         Circle circ_ = defaultParticleCircle;
         circ_.pos = pos;
         if(prev_pos.length == 0) {
             append_vector_float2(&prev_pos, pos);
         }
         while (contains_float2(&prev_pos, pos) || (!checkAABBCircAllInRect(circ_, screenBox))) {
-            pos = (float2){(float)(rand() % WIDTH), (float)(rand() % HEIGHT)};
+            pos = (float2){spawnMin.x + rng_float(rng) * spawnSize.x, spawnMin.y + rng_float(rng) * spawnSize.y};
             circ_.pos = pos;
         }
 
@@ -720,49 +2104,203 @@ void generateParticles(Vector_Particle* particles, int count) {
         new_particle.Static = false;
         new_particle.vel = (float2){0.0f, 0.0f};
 
-        append_vector_Particle(particles, new_particle);
+        appendParticleSoA(particles, new_particle);
     }
+
+    free(xs);
+    free(ys);
+    free_vector_float2(&prev_pos);
 }
 
 int main(int argc, const char * argv[]) {
-    int particle_count = 0;
+    int particle_count = 500;
+    int thread_count = get_cpu_count();
+    bool headless = false;
+    int headless_steps = 1000;
+    uint64_t seed = 0;
+    bool seed_given = false;
+    SolverMode solver = SOLVER_IMPULSE;
+    bool collisions = true;
+    ReorderSettings reorder = {
+        0,              // interval, off
+        0.5f            // miss rate
+    };
+    FixedTimestep timestep = {
+        1.0 / 60.0,     // dt
+        0,              // substeps, from the solver's timestep
+        4,              // max steps per frame
+        0.0
+    };
 
-    if(argc < 2) {
-        particle_count = 500;
-    } else {
-        particle_count = atoi(argv[1]);
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--solver") == 0 && i + 1 < argc) {
+            i++;
+            if(strcmp(argv[i], "sph") == 0) {
+                solver = SOLVER_SPH;
+            } else if(strcmp(argv[i], "pbf") == 0) {
+                solver = SOLVER_PBF;
+            } else if(strcmp(argv[i], "impulse") == 0) {
+                solver = SOLVER_IMPULSE;
+            } else {
+                printf("Unknown solver: %s, using impulse\n", argv[i]);
+            }
+        } else if(strcmp(argv[i], "--no-collisions") == 0) {
+            collisions = false;
+        } else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            thread_count = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+            seed_given = true;
+        } else if(strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        } else if(strcmp(argv[i], "--steps") == 0 && i + 1 < argc) {
+            headless_steps = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--particles") == 0 && i + 1 < argc) {
+            particle_count = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--tick-rate") == 0 && i + 1 < argc) {
+            double hz = atof(argv[++i]);
+            if(hz > 0) timestep.dt = 1.0 / hz;
+        } else if(strcmp(argv[i], "--substeps") == 0 && i + 1 < argc) {
+            timestep.substeps = atoi(argv[++i]);
+            if(timestep.substeps < 1) timestep.substeps = 1;
+        } else if(strcmp(argv[i], "--max-steps") == 0 && i + 1 < argc) {
+            timestep.maxStepsPerFrame = atoi(argv[++i]);
+            if(timestep.maxStepsPerFrame < 1) timestep.maxStepsPerFrame = 1;
+        } else if(strcmp(argv[i], "--reorder-interval") == 0 && i + 1 < argc) {
+            reorder.interval = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--reorder-miss-rate") == 0 && i + 1 < argc) {
+            reorder.missRate = atof(argv[++i]);
+        } else if(isdigit((unsigned char)argv[i][0])) {
+            // Still takes the particle count on its own, build.bat passes it like that
+            particle_count = atoi(argv[i]);
+        } else {
+            int n = (int)strlen(argv[0]);
+            printf("Unknown option: %s\n", argv[i]);
+            printf("Usage: %s [PARTICLES] [--particles N] [--solver impulse|sph|pbf] [--no-collisions]\n", argv[0]);
+            printf("       %*s [--threads N] [--seed S] [--headless] [--steps N]\n", n, "");
+            printf("       %*s [--tick-rate HZ] [--substeps N] [--max-steps N]\n", n, "");
+            printf("       %*s [--reorder-interval N] [--reorder-miss-rate F]\n", n, "");
+            return EXIT_FAILURE;
+        }
     }
 
-    srand(time(NULL));
+    // Headless runs are benchmarks, so they always spawn the same particles unless --seed says otherwise
+    if(!seed_given) {
+        seed = headless ? 1 : rng_time_seed();
+    }
+    rng_set_seed(seed);
+
+    const char* kernels = initParticleKernels();
+    initThreadPool(&threadPool, thread_count);
+
+    // Headless stdout is only the JSON report
+    if(!headless) {
+        printf("Particle kernels: %s\n", kernels);
+        printf("Threads: %d\n", threadPool.count);
+        printf("Seed: %llu\n", (unsigned long long)seed);
+    }
 
+    // Particle vs particle pushes are the impulse solver's, SPH and PBF get theirs from the fluid forces
     EngineSettings engineSettings = {
         false,
-        false,
-        false,
-        true
+        collisions && solver == SOLVER_IMPULSE,
+        solver != SOLVER_IMPULSE,
+        true,
+        solver,
+        {
+            16.0f,              // h
+            1.0f,               // mass
+            0.01f,              // rest density, one particle per 10x10 px
+            1.0e6f,             // gas constant
+            particleViscosity,  // viscosity
+            0.004f              // timestep
+        },
+        {
+            24.0f,              // h, wider than the SPH one so every particle has ~16 neighbours
+            0.01f,              // rest density
+            4,                  // iterations
+            1.0f / 60.0f,       // timestep
+            1.0e-3f,            // relaxation
+            0.1f,               // tensile k
+            0.1f                // viscosity
+        },
+        reorder
     };
 
-    GLFWwindow* window = initialize();
-    initTriangleRenderer(&triangleVAO, &triangleVBO);
+    // The fixed step is the only place that splits time, so the solver's largest stable dt
+    // decides how many substeps it takes unless --substeps says otherwise
+    if(timestep.substeps == 0) {
+        float solverDt = solver == SOLVER_SPH ? engineSettings.sph.timestep
+                       : solver == SOLVER_PBF ? engineSettings.pbf.timestep : 0.0f;
+        timestep.substeps = solverDt > 0.0f ? (int)ceil(timestep.dt / solverDt) : 1;
+        if(timestep.substeps < 1) timestep.substeps = 1;
+    }
+    if(!headless) {
+        printf("Substeps: %d\n", timestep.substeps);
+    }
+
+    GLFWwindow* window = NULL;
+    if(!headless) {
+        window = initialize();
+        initTriangleRenderer(&triangleVAO, &triangleVBO);
+
+        const char* vertSrc = load_file_as_string("Shaders/triangle_shader.vert");
+        const char* fragSrc = load_file_as_string("Shaders/triangle_shader.frag");
 
-    const char* vertSrc = load_file_as_string("Shaders/triangle_shader.vert");
-    const char* fragSrc = load_file_as_string("Shaders/triangle_shader.frag");
+        shaderProgram = createShaderProgram(vertSrc, fragSrc);
+        projectionLoc = glGetUniformLocation(shaderProgram, "uProjection");
+        updateProjection((float2){0.0f, 0.0f}, 1.0f);
 
-    shaderProgram = createShaderProgram(vertSrc, fragSrc);
+        free((void*)vertSrc);
+        free((void*)fragSrc);
 
-    free((void*)vertSrc);
-    free((void*)fragSrc);
+        initCircleRenderer(&circleVAO, &circleQuadVBO, &circleInstanceVBO);
 
-    Vector_Particle particles;
-    init_vector_Particle(&particles);
+        const char* circleVertSrc = load_file_as_string("Shaders/circle_shader.vert");
+        const char* circleFragSrc = load_file_as_string("Shaders/circle_shader.frag");
+
+        circleShaderProgram = createShaderProgram(circleVertSrc, circleFragSrc);
+        circleProjectionLoc = glGetUniformLocation(circleShaderProgram, "uProjection");
+
+        free((void*)circleVertSrc);
+        free((void*)circleFragSrc);
+    }
+
+    ParticleSoA particles;
+    initParticleSoA(&particles);
     generateParticles(&particles, particle_count);
 
+    Vector_Particle renderParticles;
+    init_vector_Particle(&renderParticles);
+
+    initParticleGrid(&particleGrid, 2 * defaultParticleCircle.r, screenBox);
+    initParticleGrid(&fluidGrid, fmaxf(engineSettings.sph.h, engineSettings.pbf.h), screenBox);
+    initNeighbourList(&neighbourList);
+    initSPHBuffers(&sphBuffers);
+    initPBFBuffers(&pbfBuffers);
+    initParticleSnapshot(&previousState);
+    initParticleReorder(&particleReorder);
+
     // append_vector_PhysicBody(&Sim_Bodies, body_1);
 
-    gameLoop(window, &particles, &engineSettings);
-    glfwTerminate();
+    if(headless) {
+        runHeadless(&particles, &engineSettings, &timestep, headless_steps, kernels);
+    } else {
+        gameLoop(window, &particles, &renderParticles, &engineSettings, &timestep);
+        glfwTerminate();
+    }
 
-    free_vector_Particle(&particles);
+    freeParticleSoA(&particles);
+    free_vector_Particle(&renderParticles);
+    freeParticleGrid(&particleGrid);
+    freeParticleGrid(&fluidGrid);
+    freeNeighbourList(&neighbourList);
+    freeSPHBuffers(&sphBuffers);
+    freePBFBuffers(&pbfBuffers);
+    freeParticleSnapshot(&previousState);
+    freeParticleReorder(&particleReorder);
+    freeThreadPool(&threadPool);
+    free_vector_CircleInstance(&circleBuffer);
 
     return EXIT_SUCCESS;
 }
@@ -2,7 +2,7 @@
 
 cls
 
-gcc app.c utils.c -o OpenGL_1.exe -lglfw3 -lglew32 -lopengl32 -lgdi32 -luser32 -lkernel32
+gcc app.c utils.c kernels.c threadpool.c rng.c -o OpenGL_1.exe -lglfw3 -lglew32 -lopengl32 -lgdi32 -luser32 -lkernel32 -lpthread
 
 if "%~1"=="" (
     echo No arguments provided, running with 500 particles
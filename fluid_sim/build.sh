@@ -3,6 +3,6 @@
 # Gonna test it later
 clear
 
-gcc app.c utils.c -o OpenGL_1 -lglfw -lGLEW -lGL
+gcc app.c utils.c kernels.c threadpool.c rng.c -o OpenGL_1 -lglfw -lGLEW -lGL -lpthread
 ./OpenGL_1
 
@@ -0,0 +1,203 @@
+#include "kernels.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+/* Scalar */
+
+static void integrateParticlesScalar(float* x, float* y, float* vx, float* vy, const uint32_t* staticMask,
+                                     size_t count, float gx, float gy, float dt) {
+    float dvx = gx * dt;
+    float dvy = gy * dt;
+    for(size_t i = 0; i < count; i++) {
+        if((staticMask[i >> 5] >> (i & 31)) & 1) continue;
+        vx[i] += dvx;
+        vy[i] += dvy;
+        x[i] += vx[i] * dt;
+        y[i] += vy[i] * dt;
+    }
+}
+
+static void clampParticlesScalar(float* x, float* y, float* vx, float* vy, size_t count,
+                                 float minX, float maxX, float minY, float maxY, float restitution) {
+    for(size_t i = 0; i < count; i++) {
+        if(x[i] < minX) { x[i] = minX; vx[i] *= -restitution; }
+        else if(x[i] > maxX) { x[i] = maxX; vx[i] *= -restitution; }
+
+        if(y[i] < minY) { y[i] = minY; vy[i] *= -restitution; }
+        else if(y[i] > maxY) { y[i] = maxY; vy[i] *= -restitution; }
+    }
+}
+
+#ifdef KERNELS_X86
+
+/* SSE2, 4 particles at a time */
+
+// Lane k is all ones when bit k of the nibble is set
+static inline __m128 staticLanesSSE2(uint32_t bits) {
+    const __m128i select = _mm_setr_epi32(1, 2, 4, 8);
+    __m128i b = _mm_and_si128(_mm_set1_epi32((int)bits), select);
+    return _mm_castsi128_ps(_mm_cmpeq_epi32(b, select));
+}
+
+// mask ? a : b
+static inline __m128 selectSSE2(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static void integrateParticlesSSE2(float* x, float* y, float* vx, float* vy, const uint32_t* staticMask,
+                                   size_t count, float gx, float gy, float dt) {
+    __m128 dvx = _mm_set1_ps(gx * dt);
+    __m128 dvy = _mm_set1_ps(gy * dt);
+    __m128 vdt = _mm_set1_ps(dt);
+
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        __m128 isStatic = staticLanesSSE2((staticMask[i >> 5] >> (i & 31)) & 0xF);
+
+        __m128 vxo = _mm_load_ps(vx + i);
+        __m128 vyo = _mm_load_ps(vy + i);
+        __m128 vxn = _mm_add_ps(vxo, dvx);
+        __m128 vyn = _mm_add_ps(vyo, dvy);
+        __m128 xo = _mm_load_ps(x + i);
+        __m128 yo = _mm_load_ps(y + i);
+        __m128 xn = _mm_add_ps(xo, _mm_mul_ps(vxn, vdt));
+        __m128 yn = _mm_add_ps(yo, _mm_mul_ps(vyn, vdt));
+
+        _mm_store_ps(vx + i, selectSSE2(isStatic, vxo, vxn));
+        _mm_store_ps(vy + i, selectSSE2(isStatic, vyo, vyn));
+        _mm_store_ps(x + i, selectSSE2(isStatic, xo, xn));
+        _mm_store_ps(y + i, selectSSE2(isStatic, yo, yn));
+    }
+
+    for(; i < count; i++) {
+        if((staticMask[i >> 5] >> (i & 31)) & 1) continue;
+        vx[i] += gx * dt;
+        vy[i] += gy * dt;
+        x[i] += vx[i] * dt;
+        y[i] += vy[i] * dt;
+    }
+}
+
+static void clampParticlesSSE2(float* x, float* y, float* vx, float* vy, size_t count,
+                               float minX, float maxX, float minY, float maxY, float restitution) {
+    __m128 vMinX = _mm_set1_ps(minX);
+    __m128 vMaxX = _mm_set1_ps(maxX);
+    __m128 vMinY = _mm_set1_ps(minY);
+    __m128 vMaxY = _mm_set1_ps(maxY);
+    __m128 bounce = _mm_set1_ps(-restitution);
+
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        __m128 xo = _mm_load_ps(x + i);
+        __m128 yo = _mm_load_ps(y + i);
+        __m128 hitX = _mm_or_ps(_mm_cmplt_ps(xo, vMinX), _mm_cmpgt_ps(xo, vMaxX));
+        __m128 hitY = _mm_or_ps(_mm_cmplt_ps(yo, vMinY), _mm_cmpgt_ps(yo, vMaxY));
+
+        _mm_store_ps(x + i, _mm_min_ps(_mm_max_ps(xo, vMinX), vMaxX));
+        _mm_store_ps(y + i, _mm_min_ps(_mm_max_ps(yo, vMinY), vMaxY));
+
+        __m128 vxo = _mm_load_ps(vx + i);
+        __m128 vyo = _mm_load_ps(vy + i);
+        _mm_store_ps(vx + i, selectSSE2(hitX, _mm_mul_ps(vxo, bounce), vxo));
+        _mm_store_ps(vy + i, selectSSE2(hitY, _mm_mul_ps(vyo, bounce), vyo));
+    }
+
+    clampParticlesScalar(x + i, y + i, vx + i, vy + i, count - i, minX, maxX, minY, maxY, restitution);
+}
+
+/* AVX2, 8 particles at a time */
+
+__attribute__((target("avx2")))
+static inline __m256 staticLanesAVX2(uint32_t bits) {
+    const __m256i select = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    __m256i b = _mm256_and_si256(_mm256_set1_epi32((int)bits), select);
+    return _mm256_castsi256_ps(_mm256_cmpeq_epi32(b, select));
+}
+
+__attribute__((target("avx2")))
+static void integrateParticlesAVX2(float* x, float* y, float* vx, float* vy, const uint32_t* staticMask,
+                                   size_t count, float gx, float gy, float dt) {
+    __m256 dvx = _mm256_set1_ps(gx * dt);
+    __m256 dvy = _mm256_set1_ps(gy * dt);
+    __m256 vdt = _mm256_set1_ps(dt);
+
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        __m256 isStatic = staticLanesAVX2((staticMask[i >> 5] >> (i & 31)) & 0xFF);
+
+        __m256 vxo = _mm256_load_ps(vx + i);
+        __m256 vyo = _mm256_load_ps(vy + i);
+        __m256 vxn = _mm256_add_ps(vxo, dvx);
+        __m256 vyn = _mm256_add_ps(vyo, dvy);
+        __m256 xo = _mm256_load_ps(x + i);
+        __m256 yo = _mm256_load_ps(y + i);
+        __m256 xn = _mm256_add_ps(xo, _mm256_mul_ps(vxn, vdt));
+        __m256 yn = _mm256_add_ps(yo, _mm256_mul_ps(vyn, vdt));
+
+        _mm256_store_ps(vx + i, _mm256_blendv_ps(vxn, vxo, isStatic));
+        _mm256_store_ps(vy + i, _mm256_blendv_ps(vyn, vyo, isStatic));
+        _mm256_store_ps(x + i, _mm256_blendv_ps(xn, xo, isStatic));
+        _mm256_store_ps(y + i, _mm256_blendv_ps(yn, yo, isStatic));
+    }
+
+    for(; i < count; i++) {
+        if((staticMask[i >> 5] >> (i & 31)) & 1) continue;
+        vx[i] += gx * dt;
+        vy[i] += gy * dt;
+        x[i] += vx[i] * dt;
+        y[i] += vy[i] * dt;
+    }
+}
+
+__attribute__((target("avx2")))
+static void clampParticlesAVX2(float* x, float* y, float* vx, float* vy, size_t count,
+                               float minX, float maxX, float minY, float maxY, float restitution) {
+    __m256 vMinX = _mm256_set1_ps(minX);
+    __m256 vMaxX = _mm256_set1_ps(maxX);
+    __m256 vMinY = _mm256_set1_ps(minY);
+    __m256 vMaxY = _mm256_set1_ps(maxY);
+    __m256 bounce = _mm256_set1_ps(-restitution);
+
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        __m256 xo = _mm256_load_ps(x + i);
+        __m256 yo = _mm256_load_ps(y + i);
+        __m256 hitX = _mm256_or_ps(_mm256_cmp_ps(xo, vMinX, _CMP_LT_OQ), _mm256_cmp_ps(xo, vMaxX, _CMP_GT_OQ));
+        __m256 hitY = _mm256_or_ps(_mm256_cmp_ps(yo, vMinY, _CMP_LT_OQ), _mm256_cmp_ps(yo, vMaxY, _CMP_GT_OQ));
+
+        _mm256_store_ps(x + i, _mm256_min_ps(_mm256_max_ps(xo, vMinX), vMaxX));
+        _mm256_store_ps(y + i, _mm256_min_ps(_mm256_max_ps(yo, vMinY), vMaxY));
+
+        __m256 vxo = _mm256_load_ps(vx + i);
+        __m256 vyo = _mm256_load_ps(vy + i);
+        _mm256_store_ps(vx + i, _mm256_blendv_ps(vxo, _mm256_mul_ps(vxo, bounce), hitX));
+        _mm256_store_ps(vy + i, _mm256_blendv_ps(vyo, _mm256_mul_ps(vyo, bounce), hitY));
+    }
+
+    clampParticlesScalar(x + i, y + i, vx + i, vy + i, count - i, minX, maxX, minY, maxY, restitution);
+}
+
+#endif
+
+IntegrateParticlesFn integrateParticlesKernel = integrateParticlesScalar;
+ClampParticlesFn clampParticlesKernel = clampParticlesScalar;
+
+const char* initParticleKernels() {
+#ifdef KERNELS_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        integrateParticlesKernel = integrateParticlesAVX2;
+        clampParticlesKernel = clampParticlesAVX2;
+        return "avx2";
+    }
+    // SSE2 is part of x86-64, so this is the floor there
+    integrateParticlesKernel = integrateParticlesSSE2;
+    clampParticlesKernel = clampParticlesSSE2;
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// SIMD kernels for the particle passes, they work straight on the ParticleSoA arrays
+// The best version for the CPU (AVX2, SSE2 or plain C) is picked by initParticleKernels
+
+// v += g * dt, p += v * dt for every particle whose bit in staticMask is clear
+typedef void (*IntegrateParticlesFn)(float* x, float* y, float* vx, float* vy, const uint32_t* staticMask,
+                                     size_t count, float gx, float gy, float dt);
+
+// Clamps the positions to [minX, maxX] x [minY, maxY] and multiplies the velocity of the
+// clamped axis by -restitution
+typedef void (*ClampParticlesFn)(float* x, float* y, float* vx, float* vy, size_t count,
+                                 float minX, float maxX, float minY, float maxY, float restitution);
+
+extern IntegrateParticlesFn integrateParticlesKernel;
+extern ClampParticlesFn clampParticlesKernel;
+
+// Returns the name of the picked kernels ("avx2", "sse2" or "scalar")
+const char* initParticleKernels();
@@ -0,0 +1,141 @@
+#include "threadpool.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+typedef struct WorkerInfo {
+    ThreadPool* pool;
+    int index;
+} WorkerInfo;
+
+int get_cpu_count() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#endif
+}
+
+static void runSlice(ThreadPool* pool, int worker) {
+    int begin = (int)((long long)pool->jobCount * worker / pool->count);
+    int end = (int)((long long)pool->jobCount * (worker + 1) / pool->count);
+    if(begin < end) {
+        pool->fn(pool->ctx, begin, end, worker);
+    }
+}
+
+static void* workerMain(void* arg) {
+    WorkerInfo* info = (WorkerInfo*)arg;
+    ThreadPool* pool = info->pool;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&pool->mutex);
+    for(;;) {
+        while(pool->generation == seen && !pool->quit) {
+            pthread_cond_wait(&pool->start, &pool->mutex);
+        }
+        if(pool->quit) break;
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->mutex);
+
+        runSlice(pool, info->index);
+
+        pthread_mutex_lock(&pool->mutex);
+        if(--pool->pending == 0) {
+            pthread_cond_signal(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    free(info);
+    return NULL;
+}
+
+void initThreadPool(ThreadPool* pool, int count) {
+    if(count < 1) count = 1;
+
+    pool->count = count;
+    pool->generation = 0;
+    pool->pending = 0;
+    pool->quit = false;
+    pool->fn = NULL;
+    pool->ctx = NULL;
+    pool->jobCount = 0;
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    pool->threads = malloc(sizeof(pthread_t) * count);
+    assert(pool->threads && "malloc failed");
+
+    // Worker 0 is the thread calling parallelFor
+    for(int i = 1; i < count; i++) {
+        WorkerInfo* info = malloc(sizeof(WorkerInfo));
+        assert(info && "malloc failed");
+        info->pool = pool;
+        info->index = i;
+
+        if(pthread_create(&pool->threads[i], NULL, workerMain, info) != 0) {
+            fprintf(stderr, "Failed to create worker %d, using %d threads\n", i, i);
+            free(info);
+            pool->count = i;
+            break;
+        }
+    }
+}
+
+void freeThreadPool(ThreadPool* pool) {
+    pthread_mutex_lock(&pool->mutex);
+    pool->quit = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for(int i = 1; i < pool->count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+
+    free(pool->threads);
+    pool->threads = NULL;
+    pool->count = 0;
+}
+
+void parallelFor(ThreadPool* pool, int count, ParallelForFn fn, void* ctx) {
+    if(count <= 0) return;
+
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->jobCount = count;
+
+    if(pool->count == 1) {
+        fn(ctx, 0, count, 0);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->pending = pool->count - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+
+    runSlice(pool, 0);
+
+    pthread_mutex_lock(&pool->mutex);
+    while(pool->pending > 0) {
+        pthread_cond_wait(&pool->done, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
@@ -1,5 +1,11 @@
 #include "utils.h"
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
 void crash(const char* s) {
     fprintf(stderr, s);
 
@@ -52,3 +58,35 @@ const char* load_file_as_string(const char* filename) {
 
 	return (const char*)buffer;
 }
+
+void* aligned_malloc(size_t alignment, size_t size) {
+#ifdef _WIN32
+    return _aligned_malloc(size, alignment);
+#else
+    // aligned_alloc wants the size to be a multiple of the alignment
+    size = (size + alignment - 1) / alignment * alignment;
+    return aligned_alloc(alignment, size);
+#endif
+}
+
+void aligned_free(void* ptr) {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+// Monotonic wall clock, for timing without a GLFW window
+double get_time_seconds() {
+#ifdef _WIN32
+    LARGE_INTEGER freq, counter;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
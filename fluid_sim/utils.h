@@ -3,6 +3,18 @@
 #include <stdio.h>
 #include <string.h>
 
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
 void crash(const char* s);
 
 const char* load_file_as_string(const char* filename);
+
+// Aligned allocations for the SIMD friendly arrays, free them with aligned_free
+void* aligned_malloc(size_t alignment, size_t size);
+
+void aligned_free(void* ptr);
+
+// Seconds from an arbitrary start point, only differences mean something
+double get_time_seconds();
@@ -0,0 +1,40 @@
+#version 330 core
+
+// One texel per cell: bit 0 right wall, bit 1 bottom wall, bit 2 top border, bit 3 left border,
+// bits 4-5 the state (unvisited, visited, finished, on the path)
+// The top and left walls are the bottom and right ones of the neighbours, like in the maze
+uniform usampler2D uMaze;
+uniform float uGrid;	// Pixels per cell
+uniform float uLine;	// Wall thickness on each side of a grid line
+uniform vec2 uOrigin;	// Top left corner of the first cell
+
+in vec2 vPos;
+out vec4 FragColor;
+
+const vec4 stateColors[4] = vec4[4](
+	vec4(0.0, 0.0, 0.0, 1.0),
+	vec4(50.0, 50.0, 150.0, 255.0) / 255.0,
+	vec4(100.0, 100.0, 150.0, 255.0) / 255.0,
+	vec4(200.0, 120.0, 40.0, 255.0) / 255.0
+);
+const vec4 wallColor = vec4(50.0, 0.0, 60.0, 255.0) / 255.0;
+
+void main() {
+	vec2 p = vPos - uOrigin;
+	ivec2 size = textureSize(uMaze, 0);
+	ivec2 cell = ivec2(floor(p / uGrid));
+	if(any(lessThan(cell, ivec2(0))) || any(greaterThanEqual(cell, size))) discard;
+
+	vec2 local = p - vec2(cell) * uGrid;
+	uint t = texelFetch(uMaze, cell, 0).r;
+
+	bool top = cell.y == 0 ? (t & 4u) != 0u : (texelFetch(uMaze, cell - ivec2(0, 1), 0).r & 2u) != 0u;
+	bool left = cell.x == 0 ? (t & 8u) != 0u : (texelFetch(uMaze, cell - ivec2(1, 0), 0).r & 1u) != 0u;
+	bool bottom = (t & 2u) != 0u;
+	bool right = (t & 1u) != 0u;
+
+	bool wall = (top && local.y < uLine) || (bottom && local.y >= uGrid - uLine) ||
+	            (left && local.x < uLine) || (right && local.x >= uGrid - uLine);
+
+	FragColor = wall ? wallColor : stateColors[(t >> 4) & 3u];
+}
@@ -0,0 +1,11 @@
+#version 330 core
+layout (location = 0) in vec2 aPos;	// Pixels
+
+uniform mat4 uProjection;
+
+out vec2 vPos;
+
+void main() {
+	gl_Position = uProjection * vec4(aPos, 0.0, 1.0);
+	vPos = aPos;
+}
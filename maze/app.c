@@ -3,6 +3,7 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <assert.h>
 #include <string.h>
 #include <limits.h>
 #include <time.h>
@@ -16,13 +17,23 @@
 // Ye
 #include "utils.h"
 #include "vector.h"
+#include "maze.h"
+#include "maze_gen.h"
+#include "maze_solve.h"
+#include "maze_flood.h"
+#include "rng.h"
+#include "eller.h"
+#include "threadpool.h"
 
-#define MAX_TRIANGLES INT_MAX/2000
+// Triangles per region to start with, the buffer doubles whenever a frame needs more
+#define TRIANGLE_START_CAPACITY 128
 
 #define FLOAT2_TO_VEC2(dest, f) glm_vec2_copy((vec2){(f).x, (f).y}, dest) // gipiti
 #define VEC2_TO_FLOAT2(v) ((float2){(v)[0], (v)[1]})
 
 // Needs to be odd for it to have space to walk and edges on all directions kinda
+// Default size, --width and --height pick another one. The window stays this size and
+// bigger mazes get zoomed out to fit
 #define MAZE_WITDH 11
 #define MAZE_HEIGHT 11
 
@@ -32,7 +43,10 @@ const GLuint WIDTH = MAZE_WITDH * GRID_SIZE + 10.0f; const GLuint HEIGHT = MAZE_
 const uint16_t CIRC_RES = 32;
 
 GLuint triangleVAO, triangleVBO;
+GLuint quadVAO, quadVBO, quadEBO;
 GLuint shaderProgram;
+GLint projectionLoc;
+mat4 projection;
 
 
 typedef vec2 pos2;
@@ -61,20 +75,8 @@ float2 float2_normalize(float2 v) {
 VECTOR_DEFINE(float2)
 
 
-typedef struct int2 {
-    int x;
-    int y;
-} int2;
-
 VECTOR_DEFINE(int2);
 
-bool contains_vector_int2(Vector_int2* vector, int2 value) {
-    for(int i = 0; i < vector->length; i++) {
-        if(vector->data[i].x == value.x && vector->data[i].y == value.y) { return true; }
-    }
-    return false;
-}
-
 typedef ivec3 int3;
 typedef ivec4 int4;
 
@@ -85,14 +87,6 @@ typedef struct Color {
     uint8_t a;
 } Color;
 
-typedef struct int_box {
-    int2 tl;
-    int2 br;
-} int_box;
-
-// Sets the bounding box for the mazes points
-int_box valid_box = {(int2){0, 0}, (int2){MAZE_WITDH - 1, MAZE_HEIGHT - 1}};
-
 typedef struct Rectangle {
     float2 pos;
     float2 size;
@@ -109,36 +103,71 @@ typedef struct Triangle {
     Vertex vertices[3];
 } Triangle;
 
+// Triangles are written straight into mapped GPU memory. With GL_ARB_buffer_storage the
+// buffer is mapped once and split in TRIANGLE_REGIONS regions, the CPU fills one while the GPU
+// still draws the others. Without it the buffer is orphaned and mapped again every frame
+#define TRIANGLE_REGIONS 3
+
 typedef struct TriangleBuffer {
-    Triangle triangles[MAX_TRIANGLES];
+    Triangle* triangles;    // Region of this frame, only valid between beginTriangles and sendTrianglesToGPU
     int count;
+    int capacity;           // Triangles per region
 } TriangleBuffer;
 
+// Rectangles go in their own batch, 4 vertices each drawn through a shared index buffer
+// (0 1 2, 0 2 3 for every quad) instead of 6 vertices as 2 triangles
+typedef struct Quad {
+    Vertex vertices[4];
+} Quad;
+
+VECTOR_DEFINE(Quad)
+
+typedef struct TriangleStream {
+    bool persistent;
+    Triangle* mapped;       // Start of the persistent mapping
+    int region;
+    GLsync fences[TRIANGLE_REGIONS];
+} TriangleStream;
+
 // Global
-TriangleBuffer triangleBuffer = {{}, 0};
+TriangleBuffer triangleBuffer = {NULL, 0, 0};
+TriangleStream triangleStream = {false, NULL, 0, {NULL}};
+Vector_Quad quadBuffer = {NULL, 0, 0};
+int quadIndexCapacity = 0;      // Quads the index buffer covers
 
 // Some CONSTANTS
 const float2 screenCenter = {WIDTH / 2.0f, HEIGHT / 2.0f};
 const Rectangle screenBox = {{0.0f, 0.0f}, {WIDTH, HEIGHT}};
 
 
-float2 toNDC(float2 screenPos) {
-    return (float2){
-        2.0f * screenPos.x / WIDTH  - 1.0f,
-        1.0f - 2.0f * screenPos.y / HEIGHT
-    };
+// Pixels (origin at the top left, y down) to clip space, done by the vertex shader
+// Panning or zooming only changes this matrix, the geometry stays in pixels
+void updateProjection(float2 pan, float zoom) {
+    glm_ortho(pan.x, pan.x + WIDTH / zoom, pan.y + HEIGHT / zoom, pan.y, -1.0f, 1.0f, projection);
 }
 
 /* Initialization(s) */
-void initTriangleRenderer(GLuint* triangleVAO, GLuint* triangleVBO) {
-    glGenVertexArrays(1, triangleVAO);
-    glGenBuffers(1, triangleVBO);
 
-    glBindVertexArray(*triangleVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, *triangleVBO);
+// Storage for the buffer bound to GL_ARRAY_BUFFER, capacity triangles per region
+void allocateTriangleStorage(int capacity) {
+    triangleBuffer.capacity = capacity;
 
-    glBufferData(GL_ARRAY_BUFFER, sizeof(Triangle) * MAX_TRIANGLES, NULL, GL_DYNAMIC_DRAW);
+    if(triangleStream.persistent) {
+        GLsizeiptr size = (GLsizeiptr)sizeof(Triangle) * capacity * TRIANGLE_REGIONS;
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
 
+        glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+        triangleStream.mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+        if(!triangleStream.mapped) {
+            crash("Failed to map the triangle buffer");
+        }
+    } else {
+        glBufferData(GL_ARRAY_BUFFER, sizeof(Triangle) * capacity, NULL, GL_STREAM_DRAW);
+    }
+}
+
+// The VAO keeps the buffer it was set up with, so this runs again when the buffer is replaced
+void setTriangleAttributes() {
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE,
                           sizeof(Vertex), (void*)(offsetof(Vertex, pos)));
     glEnableVertexAttribArray(0);
@@ -146,6 +175,33 @@ void initTriangleRenderer(GLuint* triangleVAO, GLuint* triangleVBO) {
     glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE,
                           sizeof(Vertex), (void*)(offsetof(Vertex, col)));
     glEnableVertexAttribArray(1);
+}
+
+void initTriangleRenderer(GLuint* triangleVAO, GLuint* triangleVBO) {
+    glGenVertexArrays(1, triangleVAO);
+    glGenBuffers(1, triangleVBO);
+
+    glBindVertexArray(*triangleVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, *triangleVBO);
+
+    triangleStream.persistent = GLEW_ARB_buffer_storage;
+    allocateTriangleStorage(TRIANGLE_START_CAPACITY);
+    setTriangleAttributes();
+
+    glBindVertexArray(0);
+}
+
+void initQuadRenderer(GLuint* quadVAO, GLuint* quadVBO, GLuint* quadEBO) {
+    glGenVertexArrays(1, quadVAO);
+    glGenBuffers(1, quadVBO);
+    glGenBuffers(1, quadEBO);
+
+    glBindVertexArray(*quadVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, *quadVBO);
+    setTriangleAttributes();
+
+    // The VAO remembers the index buffer
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, *quadEBO);
 
     glBindVertexArray(0);
 }
@@ -194,33 +250,155 @@ GLuint createShaderProgram(const char* vertSrc, const char* fragSrc) {
 }
 
 /* Used*/
+
+// Starts the triangles of a frame, call it before any draw
+void beginTriangles() {
+    triangleBuffer.count = 0;
+
+    if(triangleStream.persistent) {
+        int region = triangleStream.region;
+
+        // Only blocks if the GPU is still reading this region from TRIANGLE_REGIONS frames ago
+        GLsync fence = triangleStream.fences[region];
+        if(fence) {
+            while(glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {}
+            glDeleteSync(fence);
+            triangleStream.fences[region] = NULL;
+        }
+
+        triangleBuffer.triangles = triangleStream.mapped + (size_t)region * triangleBuffer.capacity;
+    } else {
+        GLsizeiptr size = sizeof(Triangle) * triangleBuffer.capacity;
+
+        // Orphaning, the driver hands out fresh memory and keeps the old one alive for the draw in flight
+        glBindBuffer(GL_ARRAY_BUFFER, triangleVBO);
+        glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+        triangleBuffer.triangles = glMapBufferRange(GL_ARRAY_BUFFER, 0, size,
+                                                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    }
+}
+
 void sendTrianglesToGPU() {
     glUseProgram(shaderProgram);
+    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, (float*)projection);
     glBindVertexArray(triangleVAO);
     glBindBuffer(GL_ARRAY_BUFFER, triangleVBO);
 
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Triangle) * triangleBuffer.count, triangleBuffer.triangles);
-    glDrawArrays(GL_TRIANGLES, 0, triangleBuffer.count * 3);
+    if(triangleStream.persistent) {
+        int first = triangleStream.region * triangleBuffer.capacity * 3;
+        glDrawArrays(GL_TRIANGLES, first, triangleBuffer.count * 3);
+
+        triangleStream.fences[triangleStream.region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        triangleStream.region = (triangleStream.region + 1) % TRIANGLE_REGIONS;
+    } else {
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glDrawArrays(GL_TRIANGLES, 0, triangleBuffer.count * 3);
+    }
+    triangleBuffer.triangles = NULL;
 
     glBindVertexArray(0);
 
 }
 
-// Prob gonna change it to GPU side rendering, like \/ gonna disappear (probably)
-void drawTriangle(Triangle* triangle) {
-    if (triangleBuffer.count >= MAX_TRIANGLES) return;
+// Called when a frame runs out of room. The triangles already written are copied on the GPU
+// to a new buffer twice as big and the frame carries on there, nothing gets dropped
+void growTriangleBuffer() {
+    GLintptr usedOffset = 0;
+    if(triangleStream.persistent) {
+        usedOffset = (GLintptr)sizeof(Triangle) * triangleStream.region * triangleBuffer.capacity;
+    }
+    GLsizeiptr used = (GLsizeiptr)sizeof(Triangle) * triangleBuffer.count;
+
+    glBindBuffer(GL_COPY_READ_BUFFER, triangleVBO);
+    // A persistent mapping can stay while the GPU copies from it, a normal one can't
+    if(!triangleStream.persistent) {
+        glUnmapBuffer(GL_COPY_READ_BUFFER);
+    }
+
+    GLuint newVBO;
+    glGenBuffers(1, &newVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, newVBO);
+    allocateTriangleStorage(triangleBuffer.capacity * 2);
 
-    Triangle ndcTriangle = *triangle;
-    for(int i = 0; i < 3; i++) {
-        ndcTriangle.vertices[i].pos = toNDC(triangle->vertices[i].pos);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_ARRAY_BUFFER, usedOffset, 0, used);
+
+    // The GPU keeps the old buffer alive until the draws still using it are done
+    glDeleteBuffers(1, &triangleVBO);
+    triangleVBO = newVBO;
+
+    for(int i = 0; i < TRIANGLE_REGIONS; i++) {
+        if(triangleStream.fences[i]) {
+            glDeleteSync(triangleStream.fences[i]);
+            triangleStream.fences[i] = NULL;
+        }
+    }
+    triangleStream.region = 0;
+
+    if(triangleStream.persistent) {
+        triangleBuffer.triangles = triangleStream.mapped;
+    } else {
+        // No invalidate bit, the copied triangles have to stay. This map waits for the copy
+        triangleBuffer.triangles = glMapBufferRange(GL_ARRAY_BUFFER, 0, sizeof(Triangle) * triangleBuffer.capacity,
+                                                    GL_MAP_WRITE_BIT);
     }
 
-    if (triangleBuffer.count >= MAX_TRIANGLES) return; // safety
-    triangleBuffer.triangles[triangleBuffer.count++] = ndcTriangle;
+    glBindVertexArray(triangleVAO);
+    setTriangleAttributes();
+    glBindVertexArray(0);
 }
 
-// Used to draw the cell
-void drawRectangle(Rectangle rect) {
+// The indices never change, they're only rebuilt (twice as many) when a frame has more quads than before
+void reserveQuadIndices(int quads) {
+    if(quads <= quadIndexCapacity) return;
+
+    int capacity = quadIndexCapacity ? quadIndexCapacity : 256;
+    while(capacity < quads) capacity *= 2;
+
+    GLuint* indices = malloc(sizeof(GLuint) * 6 * capacity);
+    assert(indices && "malloc failed");
+    for(int q = 0; q < capacity; q++) {
+        GLuint base = q * 4;
+        GLuint* i = &indices[q * 6];
+        i[0] = base; i[1] = base + 1; i[2] = base + 2;
+        i[3] = base; i[4] = base + 2; i[5] = base + 3;
+    }
+
+    glBindVertexArray(quadVAO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * 6 * capacity, indices, GL_STATIC_DRAW);
+    glBindVertexArray(0);
+
+    free(indices);
+    quadIndexCapacity = capacity;
+}
+
+void sendQuadsToGPU() {
+    if(quadBuffer.length == 0) return;
+
+    reserveQuadIndices(quadBuffer.length);
+
+    glUseProgram(shaderProgram);
+    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, (float*)projection);
+    glBindVertexArray(quadVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+
+    // Orphaned every frame like the circle instances
+    glBufferData(GL_ARRAY_BUFFER, sizeof(Quad) * quadBuffer.length, quadBuffer.data, GL_STREAM_DRAW);
+    glDrawElements(GL_TRIANGLES, quadBuffer.length * 6, GL_UNSIGNED_INT, (void*)0);
+
+    glBindVertexArray(0);
+}
+
+// Prob gonna change it to GPU side rendering, like \/ gonna disappear (probably)
+void drawTriangle(Triangle* triangle) {
+    if (!triangleBuffer.triangles) return;
+    if (triangleBuffer.count >= triangleBuffer.capacity) growTriangleBuffer();
+
+    // Write only, the mapped memory is usually write combined and slow to read back
+    triangleBuffer.triangles[triangleBuffer.count++] = *triangle;
+}
+
+Quad rectangleToQuad(Rectangle rect) {
     float hx = rect.size.x * 0.5f;
     float hy = rect.size.y * 0.5f;
 
@@ -243,11 +421,13 @@ void drawRectangle(Rectangle rect) {
                         }
                   };
 
-    Triangle t1 = { v[0], v[2], v[1] };
-    Triangle t2 = { v[0], v[2], v[3] };
+    // Corners go around the rectangle, the index buffer splits it along v[0] v[2]
+    Quad quad = {{ v[0], v[1], v[2], v[3] }};
+    return quad;
+}
 
-    drawTriangle(&t1);
-    drawTriangle(&t2);
+void drawRectangle(Rectangle rect) {
+    append_vector_Quad(&quadBuffer, rectangleToQuad(rect));
 }
 
 void drawCircle(float r, float2 pos, Color col) {
@@ -306,10 +486,7 @@ GLFWwindow* initialize() {
 
 // Generates a random number bewteen min and max inclusive
 void gen_valid_rand_num(int* num, int min, int max) {
-    *num = rand() % (max + 1);
-    while(*num < min) {
-        *num = rand() % (max + 1);
-    }
+    *num = rng_range(rng_local(), min, max);
 }
 
 void choose_rand_num(int* num, int a, int b) {
@@ -323,195 +500,441 @@ bool is_point_inside_box(int2 point, int2 box_tl, int2 box_br) {
     return (point.x >= box_tl.x && point.x <= box_br.x) && (point.y >= box_tl.y && point.y <= box_br.y);
 }
 
-typedef enum Direction {
-    top,
-    bottom,
-    left,
-    right,
-    none
-} Direction;
-
-typedef struct cell {
-    // Horizontal line
-    uint8_t wall;  // 0 0 0 0 0 0 0 0
-                   //         r l b t
-                   //         i e o o
-                   //         g f t p
-                   //         h t t
-                   //         t   o
-                   //             m
-    bool visited;
-} cell;
-
-// Represents the grid of a maze, including the edges
-typedef struct maze{
-    cell grid[MAZE_WITDH][MAZE_HEIGHT];
-} maze;
-
-void initialize_maze(maze* maze) {
-    for(int i = 0; i < MAZE_WITDH; i++) {
-        for(int j = 0; j < MAZE_HEIGHT; j++) {
-            set_bit(&maze->grid[i][j].wall, top);
-            set_bit(&maze->grid[i][j].wall, bottom);
-            set_bit(&maze->grid[i][j].wall, left);
-            set_bit(&maze->grid[i][j].wall, right);
-            maze->grid[i][j].visited = false;
-        }
-    }
-}
-
 // Empty spaces are on even coordinates
 // Edges are on odd coordinates
 
+// Shown once the maze is done, on_path stays NULL until then
+MazeSolution solution = {NULL, 0, NULL, 0, 0};
+MazeSolver solver = SOLVER_BFS;
+int2 maze_ends[2];
+
 const float h_g = GRID_SIZE / 2.0f;
 const float line_thick = 5.0f;
 const float h_l_t = line_thick / 2.0f;
 
-bool is_point_in_maze(int2 point) {
-    return is_point_inside_box(point, valid_box.tl, valid_box.br);
+// Same order as the colors in the maze texture shader
+typedef enum CellState {
+    CELL_UNVISITED,
+    CELL_VISITED,
+    CELL_FINISHED,
+    CELL_PATH
+} CellState;
+
+CellState maze_cell_state(maze* maze, int2 pos, DfsGenerator* gen) {
+    size_t i = maze_index(maze, pos);
+    // Without the DFS generator the maze is done in one go, so every visited cell is final
+    bool finished = gen ? is_cell_finished(gen, i) : is_visited_index(maze, i);
+    if(solution.on_path && is_on_path(&solution, i)) return CELL_PATH;
+    if(finished) return CELL_FINISHED;
+    if(is_visited_index(maze, i)) return CELL_VISITED;
+    return CELL_UNVISITED;
 }
 
-void render_maze(maze* maze, Vector_int2* visited_pos) {
-    Color line_color = {50, 0, 60, 255};
-    Color no_line_color = {255, 255, 255, 000};
-    Color unvisited_cell_col = {0, 0, 0, 255};
-    Color visited_cell_col = {50, 50, 150, 255};
-    Color final_cell_col = {100, 100, 150, 255};
-
-
-    for(int i = 0; i < MAZE_WITDH; i++) {
-        for(int j = 0; j < MAZE_HEIGHT; j++) {
-            int2 pos = {i, j};
-            int2 cell_offset = (int2){i * GRID_SIZE + h_l_t, j * GRID_SIZE + h_l_t};
-
-            Rectangle cell;
-            cell.size = (float2){GRID_SIZE, GRID_SIZE};
-            cell.pos = (float2){cell_offset.x + h_g, cell_offset.y + h_g};
-            if(contains_vector_int2(visited_pos, pos)) {
-                cell.col = final_cell_col;
-            } else if(maze->grid[i][j].visited == true) {
-                cell.col = visited_cell_col;
-            } else {
-                cell.col = unvisited_cell_col;
-            }
+Rectangle maze_cell_rect(maze* maze, int2 pos, DfsGenerator* gen) {
+    const Color state_cols[4] = {
+        {0, 0, 0, 255},         // Unvisited
+        {50, 50, 150, 255},     // Visited
+        {100, 100, 150, 255},   // Finished
+        {200, 120, 40, 255}     // Path
+    };
 
-            drawRectangle(cell);
+    int2 cell_offset = (int2){pos.x * GRID_SIZE + h_l_t, pos.y * GRID_SIZE + h_l_t};
 
-        }
+    Rectangle cell;
+    cell.size = (float2){GRID_SIZE, GRID_SIZE};
+    cell.pos = (float2){cell_offset.x + h_g, cell_offset.y + h_g};
+    cell.col = state_cols[maze_cell_state(maze, pos, gen)];
+    return cell;
+}
+
+// The maze geometry stays on the GPU and only what changed gets rebuilt and uploaded
+// The fills of every cell go first and the walls after them, so walls still draw on top.
+// Walls are merged along each grid line (height + 1 horizontal lines, then width + 1 vertical
+// ones) into one quad per run of walls, missing walls have no geometry at all. Every line has
+// room for its worst case (every other wall missing) and only the runs it has are drawn
+typedef struct MazeMesh {
+    GLuint vao;
+    GLuint vbo;
+    int width;
+    int height;
+    int cells;
+    bool* dirty;            // One flag per cell so a cell is only queued once
+    Vector_int2 dirty_cells;
+
+    int lines;
+    int h_slots;            // Quads kept for a horizontal line, (width + 1) / 2
+    int v_slots;            // And for a vertical one, (height + 1) / 2
+    bool* dirty_lines;
+    int* dirty_line_list;
+    int dirty_line_count;
+    Quad* line_quads;       // Scratch for rebuilding one line
+
+    // One multi-draw for the whole mesh: entry 0 is the fills, entry l + 1 is line l
+    GLsizei* draw_counts;   // Indices drawn, 6 per cell for the fills and 6 per run for a line
+    GLint* draw_bases;      // First vertex of every entry
+    const void** draw_offsets;  // All 0, the index buffer is the same for every entry
+    bool built;
+} MazeMesh;
+
+MazeMesh mazeMesh;
+ThreadPool threadPool;
+
+int maze_cell_index(int2 pos) {
+    return pos.y * mazeMesh.width + pos.x;
+}
+
+// First quad of a line in the mesh buffer
+int maze_line_base(MazeMesh* mesh, int line) {
+    if(line <= mesh->height) {
+        return mesh->cells + line * mesh->h_slots;
     }
-    for(int i = 0; i < MAZE_WITDH; i++) {
-        for(int j = 0; j < MAZE_HEIGHT; j++) {
-            int2 cell_offset = (int2){i * GRID_SIZE + h_l_t, j * GRID_SIZE + h_l_t};
+    return mesh->cells + (mesh->height + 1) * mesh->h_slots + (line - mesh->height - 1) * mesh->v_slots;
+}
 
-            // Lines
-            Rectangle line;
+// Walls of one grid line merged into runs, returns how many quads went in out
+// An inner wall is 5 pixels on each side of the line (the cell on each side used to draw its
+// half), the border ones only have the inside half
+int maze_line_runs(maze* maze, int line, Quad* out) {
+    Color line_color = {50, 0, 60, 255};
+    bool horizontal = line <= maze->height;
+    int k = horizontal ? line : line - maze->height - 1;
+    int length = horizontal ? maze->width : maze->height;
+    int across = horizontal ? maze->height : maze->width;
+
+    // Same rounding as the cell offsets
+    float at = (int)(k * GRID_SIZE + h_l_t);
+    float lo = k > 0 ? at - line_thick : at;
+    float hi = k < across ? at + line_thick : at;
+
+    int count = 0;
+    int run_start = -1;
+    for(int i = 0; i <= length; i++) {
+        bool wall = false;
+        if(i < length) {
+            int2 pos = horizontal ? (int2){i, k < across ? k : k - 1} : (int2){k < across ? k : k - 1, i};
+            Direction side = horizontal ? (k < across ? top : bottom) : (k < across ? left : right);
+            wall = check_wall(maze, pos, side);
+        }
 
-            // Top
-            line.size = (float2){GRID_SIZE, 5.0f};
-            line.pos = (float2){cell_offset.x + (GRID_SIZE / 2.0f), cell_offset.y + h_l_t};
-            if(check_bit(maze->grid[i][j].wall, top)) {
-                line.col = line_color;
+        if(wall && run_start < 0) {
+            run_start = i;
+        } else if(!wall && run_start >= 0) {
+            float from = (int)(run_start * GRID_SIZE + h_l_t);
+            float to = (int)(i * GRID_SIZE + h_l_t);
+            Rectangle rect;
+            rect.col = line_color;
+            if(horizontal) {
+                rect.size = (float2){to - from, hi - lo};
+                rect.pos = (float2){(from + to) / 2.0f, (lo + hi) / 2.0f};
             } else {
-                line.col = no_line_color;
+                rect.size = (float2){hi - lo, to - from};
+                rect.pos = (float2){(lo + hi) / 2.0f, (from + to) / 2.0f};
             }
-            drawRectangle(line);
+            out[count++] = rectangleToQuad(rect);
+            run_start = -1;
+        }
+    }
+    return count;
+}
 
-            // Bottom
-            line.size = (float2){GRID_SIZE, 5.0f};
-            line.pos = (float2){cell_offset.x + (GRID_SIZE / 2.0f), cell_offset.y + GRID_SIZE - h_l_t};
-            if(check_bit(maze->grid[i][j].wall, bottom)) {
-                line.col = line_color;
-            } else {
-                line.col = no_line_color;
-            }
-            drawRectangle(line);
+void init_maze_mesh(MazeMesh* mesh, maze* maze) {
+    mesh->width = maze->width;
+    mesh->height = maze->height;
+    mesh->cells = maze->width * maze->height;
+    mesh->dirty = calloc(mesh->cells, sizeof(bool));
+    assert(mesh->dirty && "calloc failed");
+    init_vector_int2(&mesh->dirty_cells);
+
+    mesh->lines = maze->width + maze->height + 2;
+    mesh->h_slots = (maze->width + 1) / 2;
+    mesh->v_slots = (maze->height + 1) / 2;
+    mesh->dirty_lines = calloc(mesh->lines, sizeof(bool));
+    mesh->dirty_line_list = malloc(sizeof(int) * mesh->lines);
+    mesh->dirty_line_count = 0;
+    mesh->line_quads = malloc(sizeof(Quad) * (mesh->h_slots > mesh->v_slots ? mesh->h_slots : mesh->v_slots));
+    mesh->draw_counts = calloc(mesh->lines + 1, sizeof(GLsizei));
+    mesh->draw_bases = malloc(sizeof(GLint) * (mesh->lines + 1));
+    mesh->draw_offsets = calloc(mesh->lines + 1, sizeof(void*));
+    assert(mesh->dirty_lines && mesh->dirty_line_list && mesh->line_quads && "malloc failed");
+    assert(mesh->draw_counts && mesh->draw_bases && mesh->draw_offsets && "malloc failed");
+    mesh->draw_counts[0] = mesh->cells * 6;
+    mesh->draw_bases[0] = 0;
+    for(int l = 0; l < mesh->lines; l++) {
+        mesh->draw_bases[l + 1] = maze_line_base(mesh, l) * 4;
+    }
+    mesh->built = false;
 
-            // Left
-            line.size = (float2){5.0f, GRID_SIZE};
-            line.pos = (float2){cell_offset.x + h_l_t, cell_offset.y + (GRID_SIZE / 2.0f)};
-            if(check_bit(maze->grid[i][j].wall, left)) {
-                line.col = line_color;
-            } else {
-                line.col = no_line_color;
-            }
-            drawRectangle(line);
+    // The fills are the biggest single draw, no line has more slots than there are cells
+    reserveQuadIndices(mesh->cells);
 
-            // Right
-            line.size = (float2){5.0f, GRID_SIZE};
-            line.pos = (float2){cell_offset.x + GRID_SIZE - h_l_t, cell_offset.y + (GRID_SIZE / 2.0f)};
-            if(check_bit(maze->grid[i][j].wall, right)) {
-                line.col = line_color;
-            } else {
-                line.col = no_line_color;
+    glGenVertexArrays(1, &mesh->vao);
+    glGenBuffers(1, &mesh->vbo);
+
+    glBindVertexArray(mesh->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(Quad) * maze_line_base(mesh, mesh->lines), NULL, GL_DYNAMIC_DRAW);
+    setTriangleAttributes();
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadEBO);
+
+    glBindVertexArray(0);
+}
+
+void free_maze_mesh(MazeMesh* mesh) {
+    free(mesh->dirty);
+    free_vector_int2(&mesh->dirty_cells);
+    free(mesh->dirty_lines);
+    free(mesh->dirty_line_list);
+    free(mesh->line_quads);
+    free(mesh->draw_counts);
+    free(mesh->draw_bases);
+    free(mesh->draw_offsets);
+}
+
+void mark_line_dirty(int line) {
+    if(mazeMesh.dirty_lines[line]) return;
+    mazeMesh.dirty_lines[line] = true;
+    mazeMesh.dirty_line_list[mazeMesh.dirty_line_count++] = line;
+}
+
+void mark_cell_dirty(int2 pos) {
+    // Before the first build everything gets uploaded anyway
+    if(!mazeMesh.built) return;
+
+    int c = maze_cell_index(pos);
+    if(mazeMesh.dirty[c]) return;
+    mazeMesh.dirty[c] = true;
+    append_vector_int2(&mazeMesh.dirty_cells, pos);
+
+    // Any of its 4 walls could have changed, so the lines around it get merged again
+    int v = mazeMesh.height + 1;
+    mark_line_dirty(pos.y);
+    mark_line_dirty(pos.y + 1);
+    mark_line_dirty(v + pos.x);
+    mark_line_dirty(v + pos.x + 1);
+}
+
+// Uploads the dirty cells and lines, or the whole maze the first time
+void update_maze_mesh(MazeMesh* mesh, maze* maze, DfsGenerator* gen) {
+    if(!mesh->built) {
+        int total = maze_line_base(mesh, mesh->lines);
+        Quad* quads = malloc(sizeof(Quad) * total);
+        assert(quads && "malloc failed");
+
+        for(int j = 0; j < maze->height; j++) {
+            for(int i = 0; i < maze->width; i++) {
+                int2 pos = {i, j};
+                quads[maze_cell_index(pos)] = rectangleToQuad(maze_cell_rect(maze, pos, gen));
             }
-            drawRectangle(line);
+        }
 
+        for(int l = 0; l < mesh->lines; l++) {
+            int runs = maze_line_runs(maze, l, quads + maze_line_base(mesh, l));
+            mesh->draw_counts[l + 1] = runs * 6;
         }
-    }
-}
 
-void set_wall_value(maze* maze, int2 pos, Direction dir, bool value) {
-    if(!is_point_in_maze(pos)) {
-        printf("Invalid position passed: x:%d, y:%d\n", pos.x, pos.y);
-        printf("the position must not have the coords: width: %d, height: %d\n", MAZE_WITDH, MAZE_HEIGHT);
+        // Only the fills and the runs are worth sending, the empty slots stay undefined
+        glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Quad) * mesh->cells, quads);
+        for(int l = 0; l < mesh->lines; l++) {
+            int base = maze_line_base(mesh, l);
+            glBufferSubData(GL_ARRAY_BUFFER, sizeof(Quad) * base, sizeof(Quad) * (mesh->draw_counts[l + 1] / 6), quads + base);
+        }
+        free(quads);
+
+        mesh->built = true;
         return;
     }
 
-    uint8_t* cell = &maze->grid[pos.x][pos.y].wall;
-    Direction op_dir;
+    if(mesh->dirty_cells.length == 0 && mesh->dirty_line_count == 0) return;
+
+    glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo);
+    for(int k = 0; k < mesh->dirty_cells.length; k++) {
+        int2 pos = mesh->dirty_cells.data[k];
+        int c = maze_cell_index(pos);
+
+        Quad fill = rectangleToQuad(maze_cell_rect(maze, pos, gen));
+        glBufferSubData(GL_ARRAY_BUFFER, sizeof(Quad) * c, sizeof(Quad), &fill);
+
+        mesh->dirty[c] = false;
+    }
+    mesh->dirty_cells.length = 0;
+
+    for(int k = 0; k < mesh->dirty_line_count; k++) {
+        int l = mesh->dirty_line_list[k];
+        int runs = maze_line_runs(maze, l, mesh->line_quads);
+        mesh->draw_counts[l + 1] = runs * 6;
+        glBufferSubData(GL_ARRAY_BUFFER, sizeof(Quad) * maze_line_base(mesh, l), sizeof(Quad) * runs, mesh->line_quads);
 
-    int2 adyacent_pos = pos;
-    switch(dir) {
-        case top:
-            adyacent_pos.y -= 1;
-            op_dir = bottom;
-            break;
-        case bottom:
-            adyacent_pos.y += 1;
-            op_dir = top;
-            break;
-        case left:
-            adyacent_pos.x -= 1;
-            op_dir = right;
-            break;
-        case right:
-            adyacent_pos.x += 1;
-            op_dir = left;
-            break;
-        default:
-            printf("Invalid direction passed: %d", dir);
+        mesh->dirty_lines[l] = false;
     }
+    mesh->dirty_line_count = 0;
+}
+
+void draw_maze_mesh(MazeMesh* mesh) {
+    glUseProgram(shaderProgram);
+    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, (float*)projection);
+    glBindVertexArray(mesh->vao);
+    // The fills and then one entry per line, each starting at its own slots and only as long
+    // as its runs, all in a single call
+    glMultiDrawElementsBaseVertex(GL_TRIANGLES, mesh->draw_counts, GL_UNSIGNED_INT,
+                                  (const void* const*)mesh->draw_offsets, mesh->lines + 1, mesh->draw_bases);
+    glBindVertexArray(0);
+}
+
+// The other way to draw the maze, no geometry at all: one texel per cell with its walls and
+// state, and a fragment shader that works out the walls from the pixel position on a single
+// quad over the whole maze. A changed cell is a one texel upload, so the cost doesn't grow with
+// the maze and million cell mazes still run
+typedef struct MazeTexture {
+    GLuint texture;
+    GLuint vao;
+    GLuint vbo;
+    GLuint program;
+    GLint projectionLoc;
+    int width;
+    int height;
+    bool* dirty;
+    Vector_int2 dirty_cells;
+    bool built;
+} MazeTexture;
+
+MazeTexture mazeTexture;
+bool textureRender = false;
+
+// Bit 0 right wall, bit 1 bottom wall, bit 2 top border, bit 3 left border, bits 4-5 the state
+uint8_t maze_cell_texel(maze* maze, int2 pos, DfsGenerator* gen) {
+    uint8_t texel = get_cell_walls(maze, maze_index(maze, pos));
+    if(pos.y == 0 && check_wall(maze, pos, top)) texel |= 4;
+    if(pos.x == 0 && check_wall(maze, pos, left)) texel |= 8;
+    return texel | (uint8_t)(maze_cell_state(maze, pos, gen) << 4);
+}
 
-    if(value) { set_bit(cell, dir); } else { clear_bit(cell, dir); }
-    if(is_point_in_maze(adyacent_pos)) {
-        uint8_t* adyacent_cell = &maze->grid[adyacent_pos.x][adyacent_pos.y].wall;
-        if(value) { set_bit(adyacent_cell, op_dir); } else { clear_bit(adyacent_cell, op_dir); }
+// Returns false if the maze is bigger than the biggest texture the GPU takes
+bool init_maze_texture(MazeTexture* tex, maze* maze) {
+    GLint max_size;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+    if(maze->width > max_size || maze->height > max_size) {
+        printf("Maze doesn't fit in a %d x %d texture\n", max_size, max_size);
+        return false;
     }
+
+    tex->width = maze->width;
+    tex->height = maze->height;
+    tex->dirty = calloc((size_t)maze->width * maze->height, sizeof(bool));
+    assert(tex->dirty && "calloc failed");
+    init_vector_int2(&tex->dirty_cells);
+    tex->built = false;
+
+    const char* vertSrc = load_file_as_string("Shaders/maze_texture.vert");
+    const char* fragSrc = load_file_as_string("Shaders/maze_texture.frag");
+    tex->program = createShaderProgram(vertSrc, fragSrc);
+    free((void*)vertSrc);
+    free((void*)fragSrc);
+
+    tex->projectionLoc = glGetUniformLocation(tex->program, "uProjection");
+    glUseProgram(tex->program);
+    glUniform1i(glGetUniformLocation(tex->program, "uMaze"), 0);
+    glUniform1f(glGetUniformLocation(tex->program, "uGrid"), GRID_SIZE);
+    glUniform1f(glGetUniformLocation(tex->program, "uLine"), line_thick);
+    // Same rounding as the cell offsets of the mesh
+    glUniform2f(glGetUniformLocation(tex->program, "uOrigin"), (int)h_l_t, (int)h_l_t);
+
+    // Integer texture, no filtering, the shader reads it with texelFetch
+    glGenTextures(1, &tex->texture);
+    glBindTexture(GL_TEXTURE_2D, tex->texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, maze->width, maze->height, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, NULL);
+
+    // The one quad, covering the maze in pixels like the mesh did
+    Rectangle box;
+    box.size = (float2){maze->width * GRID_SIZE + line_thick * 2.0f, maze->height * GRID_SIZE + line_thick * 2.0f};
+    box.pos = (float2){box.size.x / 2.0f, box.size.y / 2.0f};
+    box.col = (Color){0, 0, 0, 255};
+    Quad quad = rectangleToQuad(box);
+
+    reserveQuadIndices(1);
+    glGenVertexArrays(1, &tex->vao);
+    glGenBuffers(1, &tex->vbo);
+    glBindVertexArray(tex->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, tex->vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(Quad), &quad, GL_STATIC_DRAW);
+    setTriangleAttributes();
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadEBO);
+    glBindVertexArray(0);
+
+    return true;
 }
 
-void set_wall(maze* maze, int2 pos, Direction dir) {
-    set_wall_value(maze, pos, dir, true);
+void free_maze_texture(MazeTexture* tex) {
+    free(tex->dirty);
+    free_vector_int2(&tex->dirty_cells);
+    glDeleteTextures(1, &tex->texture);
+    glDeleteBuffers(1, &tex->vbo);
+    glDeleteVertexArrays(1, &tex->vao);
+    glDeleteProgram(tex->program);
 }
 
-void clear_wall(maze* maze, int2 pos, Direction dir) {
-    set_wall_value(maze, pos, dir, false);
+void mark_texel_dirty(int2 pos) {
+    if(!mazeTexture.built) return;
+
+    size_t c = (size_t)pos.y * mazeTexture.width + pos.x;
+    if(mazeTexture.dirty[c]) return;
+    mazeTexture.dirty[c] = true;
+    append_vector_int2(&mazeTexture.dirty_cells, pos);
+}
+
+// Uploads the dirty texels, or all of them the first time
+void update_maze_texture(MazeTexture* tex, maze* maze, DfsGenerator* gen) {
+    glBindTexture(GL_TEXTURE_2D, tex->texture);
+
+    if(!tex->built) {
+        uint8_t* row = malloc(maze->width);
+        assert(row && "malloc failed");
+        for(int j = 0; j < maze->height; j++) {
+            for(int i = 0; i < maze->width; i++) {
+                row[i] = maze_cell_texel(maze, (int2){i, j}, gen);
+            }
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, j, maze->width, 1, GL_RED_INTEGER, GL_UNSIGNED_BYTE, row);
+        }
+        free(row);
+
+        tex->built = true;
+        return;
+    }
+
+    // A wall only lives in one texel (the cell above or on the left of it), so a step of the
+    // generator is a couple of single texel uploads
+    for(int k = 0; k < tex->dirty_cells.length; k++) {
+        int2 pos = tex->dirty_cells.data[k];
+        uint8_t texel = maze_cell_texel(maze, pos, gen);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, pos.x, pos.y, 1, 1, GL_RED_INTEGER, GL_UNSIGNED_BYTE, &texel);
+        tex->dirty[(size_t)pos.y * tex->width + pos.x] = false;
+    }
+    tex->dirty_cells.length = 0;
 }
 
-bool check_wall(maze* maze, int2 pos, Direction dir) {
-    uint8_t* cell = &maze->grid[pos.x][pos.y].wall;
-    return check_bit(*cell, dir);
+void draw_maze_texture(MazeTexture* tex) {
+    glUseProgram(tex->program);
+    glUniformMatrix4fv(tex->projectionLoc, 1, GL_FALSE, (float*)projection);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, tex->texture);
+    glBindVertexArray(tex->vao);
+    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (void*)0);
+    glBindVertexArray(0);
 }
 
-void choose_pos(int2* walker_pos) {
+void choose_pos(maze* maze, int2* walker_pos) {
     int2 pos;
-    gen_valid_rand_num(&pos.x, 0, MAZE_WITDH - 1);
-    gen_valid_rand_num(&pos.y, 0, MAZE_WITDH - 1);
+    gen_valid_rand_num(&pos.x, 0, maze->width - 1);
+    gen_valid_rand_num(&pos.y, 0, maze->height - 1);
     *walker_pos = pos;
 }
 
 
 void choose_dir(Direction* dir) {
-    *dir = rand() % 4;
+    *dir = rng_below(rng_local(), 4);
 }
 
 void get_oppositide_dir(Direction dir, Direction* op) {
@@ -521,397 +944,557 @@ void get_oppositide_dir(Direction dir, Direction* op) {
     if(dir == right) { *op = right; return; }
 }
 
-void choose_point_outside_ring(int2* pos) {
+void choose_point_outside_ring(maze* maze, int2* pos) {
     int2 point;
 
-    bool axis = rand() % 2;
+    bool axis = rng_below(rng_local(), 2);
 
     if(axis) {
-        choose_rand_num(&point.x, 0, MAZE_WITDH - 1);
-        gen_valid_rand_num(&point.y, 0, MAZE_HEIGHT - 1);
+        choose_rand_num(&point.x, 0, maze->width - 1);
+        gen_valid_rand_num(&point.y, 0, maze->height - 1);
     } else {
-        gen_valid_rand_num(&point.x, 0, MAZE_WITDH - 1);
-        choose_rand_num(&point.y, 0, MAZE_HEIGHT - 1);
+        gen_valid_rand_num(&point.x, 0, maze->width - 1);
+        choose_rand_num(&point.y, 0, maze->height - 1);
     }
 
     *pos = point;
 }
 
-void get_outside_wall_from_outside_ring_point(int2 pos, Direction* wall) {
+void get_outside_wall_from_outside_ring_point(maze* maze, int2 pos, Direction* wall) {
     Direction side;
     if(pos.x == 0) { side = left; }
-    if(pos.x == (MAZE_WITDH - 1)) { side = right; }
+    if(pos.x == (maze->width - 1)) { side = right; }
     if(pos.y == 0) { side = top; }
-    if(pos.y == (MAZE_HEIGHT - 1)) { side = bottom; }
+    if(pos.y == (maze->height - 1)) { side = bottom; }
 
     *wall = side;
 }
 
 bool is_outside_ring_wall(maze* maze, int2 pos, Direction dir) {
-    if(!is_point_in_maze(pos)) {
+    if(!is_point_in_maze(maze, pos)) {
         printf("Invalid position has been passed to is_border__wall(...)\n");
         return false;
     }
 
     if(pos.y == 0 && dir == top) { return true; }
-    if(pos.y == (MAZE_HEIGHT - 1) && dir == bottom) { return true; }
+    if(pos.y == (maze->height - 1) && dir == bottom) { return true; }
     if(pos.x == 0 && dir == left) { return true; }
-    if(pos.x == (MAZE_WITDH - 1) && dir == right) { return true; }
+    if(pos.x == (maze->width - 1) && dir == right) { return true; }
 
     return false;
 }
 
 
-bool is_point_outside_ring(int2 pos) {
-    if(!is_point_in_maze(pos)) {
+bool is_point_outside_ring(maze* maze, int2 pos) {
+    if(!is_point_in_maze(maze, pos)) {
         printf("Invalid position has been passed to is_border__wall(...)\n");
         return false;
     }
 
     if(pos.y == 0) { return true; }
-    if(pos.y == (MAZE_HEIGHT - 1)) { return true; }
+    if(pos.y == (maze->height - 1)) { return true; }
     if(pos.x == 0) { return true; }
-    if(pos.x == (MAZE_WITDH - 1)) { return true; }
+    if(pos.x == (maze->width - 1)) { return true; }
 
     return false;
 }
 
-typedef struct Walker {
-    int2 head;
-    Direction dir;
-} Walker;
-
-
-void dir_from_adyacent_ab(int2 a, int2 b, Direction* dir) {
-    int2 diff = (int2){b.x - a.x, b.y - a.y};
-    Direction dir_;
-    if(diff.x == 0 && diff.y != 0) {
-        if(diff.y < 0) { *dir = top; }
-        else { *dir = bottom; }
-    } else if(diff.x != 0 && diff.y == 0) {
-        if(diff.x < 0) { *dir = left; }
-        else { *dir = right; }
-    } else { *dir =  none; }
-}
-
-void dir_from_walker_to_walker(Walker walker_a, Walker walker_b, Direction* dir) {
-    dir_from_adyacent_ab(walker_a.head, walker_b.head, dir);
-}
-
-void predict_new_pos(Walker walker, int2* prediction) {
-    int2 new_pos = walker.head;
-    switch(walker.dir) {
-        case top:
-            new_pos.y -= 1;
-            break;
-        case bottom:
-            new_pos.y += 1;
-            break;
-        case left:
-            new_pos.x -= 1;
-            break;
-        case right:
-            new_pos.x += 1;
-            break;
-        default:
-            printf("hmmm.... no direction for walker given...\n");
-            break;
-    }
-
-    *prediction =new_pos;
-}
-
-void predict_new_pos_in_dir(Walker walker, Direction dir, int2* prediction) {
-    int2 new_pos = walker.head;
-    switch(dir) {
-        case top:
-            new_pos.y -= 1;
-            break;
-        case bottom:
-            new_pos.y += 1;
-            break;
-        case left:
-            new_pos.x -= 1;
-            break;
-        case right:
-            new_pos.x += 1;
-            break;
-        default:
-            printf("hmmm.... no direction for walker given...\n");
-            break;
-    }
-
-    *prediction =new_pos;
-}
-
-bool move_walker_in_dir(Walker* walker) {
-    int2 new_pos = walker->head;
-    switch(walker->dir) {
-        case top:
-            new_pos.y -= 1;
-            break;
-        case bottom:
-            new_pos.y += 1;
-            break;
-        case left:
-            new_pos.x -= 1;
-            break;
-        case right:
-            new_pos.x += 1;
-            break;
-        default:
-            printf("hmmm.... no direction for walker given...\n");
-            break;
-    }
-    if(!is_point_in_maze(new_pos)) { return false; }
-
-    walker->head = new_pos;
-    return true;
-}
+// Opens two walls on the border, returns the cell of the first one so the generator starts there
+// and puts the second one in exit
+int2 open_entrances(maze* maze, int2* exit) {
+    int2 entrance = {0, 0};
+    int2 tmp_pos;
+    Direction tmp_dir;
 
-bool is_pointing_wall(maze* maze, Walker walker) {
-    return check_wall(maze, walker.head, walker.dir);
-}
-
-bool can_move_walker_in_dir(maze* maze, Walker* walker) {
-    int2 new_pos = walker->head;
-    switch(walker->dir) {
-        case top:
-            new_pos.y -= 1;
-            break;
-        case bottom:
-            new_pos.y += 1;
-            break;
-        case left:
-            new_pos.x -= 1;
-            break;
-        case right:
-            new_pos.x += 1;
-            break;
-        default:
-            printf("hmmm.... no direction for walker given...\n");
-            break;
-    }
-    if(!is_point_in_maze(new_pos)) { return false; }
-    if(maze->grid[new_pos.x][new_pos.y].visited == true) { return false; }
+    for(int i = 0; i < 2; i++) {
+        do {
+            choose_point_outside_ring(maze, &tmp_pos);
+            get_outside_wall_from_outside_ring_point(maze, tmp_pos, &tmp_dir);
+            // Corners (and every side of a 1x1 maze) have more than one border wall, try the
+            // others before picking a new cell or a 1x1 maze never finds its exit
+            for(int d = top; d <= right && !check_wall(maze, tmp_pos, tmp_dir); d++) {
+                if(is_outside_ring_wall(maze, tmp_pos, (Direction)d)) { tmp_dir = (Direction)d; }
+            }
+        } while(!check_wall(maze, tmp_pos, tmp_dir));
 
-    return true;
+        clear_wall(maze, tmp_pos, tmp_dir);
+        if(i == 0) { entrance = tmp_pos; }
+        else { *exit = tmp_pos; }
+    }
+    return entrance;
 }
 
-bool can_move_walker_in_visited(maze* maze, Walker* walker, Vector_int2* visited_pos) {
-    int2 new_pos = walker->head;
-    switch(walker->dir) {
-        case top:
-            new_pos.y -= 1;
-            break;
-        case bottom:
-            new_pos.y += 1;
-            break;
-        case left:
-            new_pos.x -= 1;
-            break;
-        case right:
-            new_pos.x += 1;
-            break;
-        default:
-            printf("hmmm.... no direction for walker given...\n");
-            break;
-    }
-    if(!is_point_in_maze(new_pos) ||
-       maze->grid[new_pos.x][new_pos.y].visited == false ||
-       check_wall(maze, walker->head, walker->dir) ||
-       contains_vector_int2(visited_pos, new_pos)) {
+// Generates the whole maze and prints how long it took as a JSON object, indented by indent spaces
+bool timeGenerator(maze* maze, MazeGenerator generator, uint64_t seed, int indent) {
+    int2 exit;
+    int2 entrance = open_entrances(maze, &exit);
+
+    double start = get_time_seconds();
+    if(!gen_maze_with(generator, maze, entrance, seed)) {
         return false;
     }
-
+    double wall_time = get_time_seconds() - start;
+
+    size_t cells = (size_t)maze->width * maze->height;
+    int n = indent;
+
+    printf("%*s{\n", n, "");
+    printf("%*s  \"generator\": \"%s\",\n", n, "", generator_names[generator]);
+    printf("%*s  \"seed\": %llu,\n", n, "", (unsigned long long)rng_get_seed());
+    printf("%*s  \"threads\": %d,\n", n, "", generator == GENERATOR_TILED ? threadPool.count : 1);
+    printf("%*s  \"width\": %d,\n", n, "", maze->width);
+    printf("%*s  \"height\": %d,\n", n, "", maze->height);
+    printf("%*s  \"cells\": %zu,\n", n, "", cells);
+    printf("%*s  \"wall_time_s\": %.6f,\n", n, "", wall_time);
+    printf("%*s  \"cells_per_sec\": %.1f,\n", n, "", cells / wall_time);
+    printf("%*s  \"maze_bytes\": %zu,\n", n, "", maze_memory_bytes(maze));
+    printf("%*s  \"generator_bytes\": %zu\n", n, "", generator_bytes(generator, cells));
+    printf("%*s}", n, "");
     return true;
 }
 
-bool is_enclosed_by_visited_pos(maze* maze, Walker walker) {
-    int2 predicted_pos;
-    Walker tmp_walker = walker;
-    for(int i = 0; i < 4; i++) {
-        tmp_walker.dir = i;
-        predict_new_pos(tmp_walker, &predicted_pos);
-        if(is_point_in_maze(predicted_pos)) {
-            if(maze->grid[predicted_pos.x][predicted_pos.y].visited == false) {
-                return false;
-            }
-        }
-    }
-    return true;
+// Generates the whole maze without a window and prints how long it took as JSON
+int runHeadless(maze* maze, MazeGenerator generator, uint64_t seed) {
+    if(!timeGenerator(maze, generator, seed, 0)) return EXIT_FAILURE;
+    printf("\n");
+    return EXIT_SUCCESS;
 }
 
-void backtrack_walker(maze* maze, Walker* walker, Walker* prev_walker, Vector_int2* visited_pos) {
-    int2 predicted_pos;
-    predict_new_pos(*walker, &predicted_pos);
-
-    int choosed_num = 0;
-    while(!can_move_walker_in_visited(maze, walker, visited_pos)) {
-        if(choosed_num >= 4) { return; }
-        printf("Choosing new dir to backtrack..., prev: %d\n", walker->dir);
-        choose_dir(&walker->dir);
-        choosed_num++;
+// Every generator on the same size and seed, one after the other
+int runBenchmark(maze* maze, uint64_t seed) {
+    printf("[\n");
+    for(int g = 0; g < GENERATOR_COUNT; g++) {
+        reset_maze(maze);
+        if(!timeGenerator(maze, g, seed, 2)) return EXIT_FAILURE;
+        printf("%s\n", g + 1 < GENERATOR_COUNT ? "," : "");
+        fflush(stdout);
     }
-    if(maze->grid[predicted_pos.x][predicted_pos.y].visited == true)
-        append_vector_int2(visited_pos, walker->head);
-    move_walker_in_dir(walker);
+    printf("]\n");
+    return EXIT_SUCCESS;
 }
 
-// Recursive backtracking
-void gen_maze(maze* maze, Walker* walker, Walker* prev_walker, int step, Vector_int2* visited_pos, bool* backtrack_nearest, bool* end_gen) {
-    int2 tmp_pos;
-    Direction tmp_dir;
-    Direction tmp_dir_2;
-
-    srand(time(NULL));
-
-    printf("backtrack_nearest: %d\n", *backtrack_nearest);
-    if(*backtrack_nearest) {
-        printf("backtracking to nearest...\n");
-        backtrack_walker(maze, walker, prev_walker, visited_pos);
-        return;
+// Generates one maze and runs every solver on it between the two entrances
+int runSolveBenchmark(maze* maze, MazeGenerator generator, uint64_t seed) {
+    int2 exit;
+    int2 entrance = open_entrances(maze, &exit);
+    if(!gen_maze_with(generator, maze, entrance, seed)) return EXIT_FAILURE;
+
+    size_t cells = (size_t)maze->width * maze->height;
+    printf("[\n");
+    for(int s = 0; s < SOLVER_COUNT; s++) {
+        MazeSolution result;
+        double start = get_time_seconds();
+        if(!solve_maze_with(s, maze, entrance, exit, &result)) return EXIT_FAILURE;
+        double wall_time = get_time_seconds() - start;
+
+        printf("  {\n");
+        printf("    \"solver\": \"%s\",\n", solver_names[s]);
+        printf("    \"generator\": \"%s\",\n", generator_names[generator]);
+        printf("    \"seed\": %llu,\n", (unsigned long long)rng_get_seed());
+        printf("    \"width\": %d,\n", maze->width);
+        printf("    \"height\": %d,\n", maze->height);
+        printf("    \"cells\": %zu,\n", cells);
+        printf("    \"path_length\": %zu,\n", result.length);
+        printf("    \"expanded\": %zu,\n", result.expanded);
+        printf("    \"wall_time_s\": %.6f,\n", wall_time);
+        printf("    \"expanded_per_sec\": %.1f,\n", result.expanded / wall_time);
+        printf("    \"scratch_bytes\": %zu\n", result.scratch_bytes);
+        printf("  }%s\n", s + 1 < SOLVER_COUNT ? "," : "");
+        fflush(stdout);
+
+        free_maze_solution(&result);
     }
+    printf("]\n");
+    return EXIT_SUCCESS;
+}
 
-
-    // If the step if the 0th or the 1st then add the entrances and put the
-    // walker on the maze
-    if(step < 2) {
-        do {
-            choose_point_outside_ring(&tmp_pos);
-            get_outside_wall_from_outside_ring_point(tmp_pos, &tmp_dir);
-        } while(!check_wall(maze, tmp_pos, tmp_dir));
-
-        clear_wall(maze, tmp_pos, tmp_dir);
-
-        if(step < 1) {
-            walker->head = tmp_pos;
-            maze->grid[tmp_pos.x][tmp_pos.y].visited = true;
-        }
-        return;
+// Distances as a grey PGM, black at the start and white at the far end, unreachable cells are black
+bool writeHeatmap(const char* path, const uint32_t* dist, int width, int height, uint32_t layers) {
+    FILE* out = fopen(path, "wb");
+    if(!out) {
+        perror("Error opening heatmap file");
+        return false;
     }
-
-    // If this is an actual step then make the walker walk and open walls
-    Walker tmp_walker = *walker;
-    int2 predicted_pos;
-    do {
-        if(is_enclosed_by_visited_pos(maze, *walker)) {
-            *backtrack_nearest = true;
-            return;
+    fprintf(out, "P5\n%d %d\n255\n", width, height);
+
+    uint8_t* row = malloc(width);
+    assert(row && "malloc failed");
+    double scale = layers > 1 ? 255.0 / (layers - 1) : 0.0;
+    for(int y = 0; y < height; y++) {
+        for(int x = 0; x < width; x++) {
+            uint32_t d = dist[(size_t)y * width + x];
+            row[x] = d == UINT32_MAX ? 0 : (uint8_t)(d * scale);
         }
-        do {
-            choose_dir(&tmp_dir);
-            dir_from_walker_to_walker(*walker, *prev_walker, &tmp_dir_2);
-        } while(tmp_dir_2 == tmp_dir);
-
-
-        walker->dir = tmp_dir;
-        predict_new_pos(*walker, &predicted_pos);
+        fwrite(row, 1, width, out);
+    }
+    free(row);
+    fclose(out);
+    return true;
+}
 
-    } while(!can_move_walker_in_dir(maze, walker));
-    move_walker_in_dir(walker);
-    maze->grid[predicted_pos.x][predicted_pos.y].visited = true;
+// Generates a maze, checks every cell can be reached with the bit-parallel flood fill and
+// times the distance layers from the entrance, optionally saving them as a heatmap
+int runFlood(maze* maze, MazeGenerator generator, uint64_t seed, const char* heatmap_path) {
+    int2 exit;
+    int2 entrance = open_entrances(maze, &exit);
+    if(!gen_maze_with(generator, maze, entrance, seed)) return EXIT_FAILURE;
+
+    const char* kernel = init_flood_kernels();
+    size_t cells = (size_t)maze->width * maze->height;
+
+    double start = get_time_seconds();
+    FloodMasks masks;
+    if(!init_flood_masks(&masks, maze)) return EXIT_FAILURE;
+    double masks_time = get_time_seconds() - start;
+
+    uint64_t* reached = malloc(sizeof(uint64_t) * flood_bitset_words(&masks));
+    uint32_t* dist = heatmap_path ? malloc(sizeof(uint32_t) * cells) : NULL;
+    if(!reached || (heatmap_path && !dist)) {
+        printf("Not enough memory for the flood fill\n");
+        free(reached);
+        free(dist);
+        free_flood_masks(&masks);
+        return EXIT_FAILURE;
+    }
 
+    start = get_time_seconds();
+    size_t reachable = flood_reachable(&masks, entrance, reached);
+    double reach_time = get_time_seconds() - start;
+
+    start = get_time_seconds();
+    size_t layer_cells = 0;
+    uint32_t layers = flood_distances(&masks, entrance, dist, &layer_cells);
+    double distance_time = get_time_seconds() - start;
+
+    bool saved = heatmap_path && writeHeatmap(heatmap_path, dist, maze->width, maze->height, layers);
+
+    printf("{\n");
+    printf("  \"generator\": \"%s\",\n", generator_names[generator]);
+    printf("  \"seed\": %llu,\n", (unsigned long long)rng_get_seed());
+    printf("  \"width\": %d,\n", maze->width);
+    printf("  \"height\": %d,\n", maze->height);
+    printf("  \"cells\": %zu,\n", cells);
+    printf("  \"kernel\": \"%s\",\n", kernel);
+    printf("  \"reachable\": %zu,\n", reachable);
+    printf("  \"all_reachable\": %s,\n", reachable == cells ? "true" : "false");
+    printf("  \"layers\": %u,\n", layers);
+    printf("  \"masks_time_s\": %.6f,\n", masks_time);
+    printf("  \"reach_time_s\": %.6f,\n", reach_time);
+    printf("  \"distance_time_s\": %.6f,\n", distance_time);
+    printf("  \"heatmap\": %s\n", saved ? "true" : "false");
+    printf("}\n");
+
+    free(reached);
+    free(dist);
+    free_flood_masks(&masks);
+    return layer_cells == reachable ? EXIT_SUCCESS : EXIT_FAILURE;
+}
 
-    *prev_walker = tmp_walker;
-    clear_wall(maze, prev_walker->head, tmp_dir);
+// Streams an Eller maze to a file ("-" for stdout) without ever holding more than a row
+int runEller(const char* path, MazeFormat format, int width, int height, uint64_t seed) {
+    bool to_stdout = strcmp(path, "-") == 0;
+    FILE* out = to_stdout ? stdout : fopen(path, format == MAZE_FORMAT_BINARY ? "wb" : "w");
+    if(!out) {
+        perror("Error opening output file");
+        return EXIT_FAILURE;
+    }
+    // Big writes, the rows are tiny next to what the disk wants
+    setvbuf(out, NULL, _IOFBF, 1 << 20);
+
+    double start = get_time_seconds();
+    uint64_t bytes = write_eller_maze(out, format, width, height, seed);
+    fflush(out);
+    double wall_time = get_time_seconds() - start;
+    if(!to_stdout) fclose(out);
+    if(bytes == 0) return EXIT_FAILURE;
+
+    // The report can't go in the middle of the maze
+    FILE* report = to_stdout ? stderr : stdout;
+    double cells = (double)width * height;
+    fprintf(report, "{\n");
+    fprintf(report, "  \"generator\": \"eller\",\n");
+    fprintf(report, "  \"seed\": %llu,\n", (unsigned long long)rng_get_seed());
+    fprintf(report, "  \"width\": %d,\n", width);
+    fprintf(report, "  \"height\": %d,\n", height);
+    fprintf(report, "  \"format\": \"%s\",\n", format == MAZE_FORMAT_BINARY ? "binary" : "ascii");
+    fprintf(report, "  \"bytes\": %llu,\n", (unsigned long long)bytes);
+    fprintf(report, "  \"wall_time_s\": %.6f,\n", wall_time);
+    fprintf(report, "  \"cells_per_sec\": %.1f,\n", cells / wall_time);
+    fprintf(report, "  \"mb_per_sec\": %.1f\n", bytes / wall_time / 1e6);
+    fprintf(report, "}\n");
+    return EXIT_SUCCESS;
 }
 
 
 /* Main Functions */
-void updateScene(double deltaTime, double* time_elapsed, maze* maze, int* step, Walker* walker, Walker* prev_walker, Vector_int2* visited_pos, bool* backtrack_nearest, bool* end_gen) {
-    if(*time_elapsed >= 0.05 && !*end_gen) {
-        printf("Step: %d\n", *step);
-        gen_maze(maze, walker, prev_walker, *step, visited_pos, backtrack_nearest, end_gen);
-        *time_elapsed = 0.0;
-        *step = *step + 1;
+// Solves between the two entrances and marks the path so the mesh or the texture picks it up
+void showSolution(maze* maze) {
+    if(!solve_maze_with(solver, maze, maze_ends[0], maze_ends[1], &solution)) return;
+    printf("Solved with %s: %zu cells on the path, %zu expanded\n", solver_names[solver], solution.length, solution.expanded);
+
+    size_t cells = (size_t)maze->width * maze->height;
+    for(size_t i = 0; i < cells; i++) {
+        if(is_on_path(&solution, i) && maze->on_change) maze->on_change((int2){i % maze->width, i / maze->width});
     }
-    if(*end_gen) {
-        printf("Maze generation stopped...\n");
+}
+
+// Carves up to cells_per_frame cells every frame
+void updateScene(DfsGenerator* gen, int cells_per_frame, bool* end_gen) {
+    if(*end_gen || !gen) return;
+
+    if(!step_dfs_generator(gen, cells_per_frame)) {
+        *end_gen = true;
+        printf("Maze generation done...\n");
+        showSolution(gen->maze);
     }
-    return;
 }
 
 // Exmplae to make a trail for a body
 // Probably gonna change to a easier way to make trails for bodies
 // Trail bodyTrail;
 
-void renderScene(GLFWwindow* window, maze* maze, Walker walker, Walker prev_walker, Vector_int2* visited_pos) {
+void renderScene(GLFWwindow* window, maze* maze, DfsGenerator* gen) {
     //glClearColor(0.05f, 0.05f, 0.1f, 1.0f);
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
 
-    triangleBuffer.count = 0;
+    beginTriangles();
+    quadBuffer.length = 0;
 
     // Test
     // Rectangle a = {{200.0f, 204.0f}, {50.0f, 100.0f}, {255, 255, 0, 255}};
     // drawRectangle(a);
-    render_maze(maze, visited_pos);
+    // Drawn right away, the walker goes on top of it
+    if(textureRender) {
+        update_maze_texture(&mazeTexture, maze, gen);
+        draw_maze_texture(&mazeTexture);
+    } else {
+        update_maze_mesh(&mazeMesh, maze, gen);
+        draw_maze_mesh(&mazeMesh);
+    }
 
-    float walker_r = 25.0f;
-    float2 walker_pos = {walker.head.x * GRID_SIZE + h_g + h_l_t, walker.head.y * GRID_SIZE + h_g + h_l_t};
-    float2 prev_walker_pos = {prev_walker.head.x * GRID_SIZE + h_g + h_l_t, prev_walker.head.y * GRID_SIZE + h_g + h_l_t};
+    // The head of the generator and the cell it came from
+    if(gen && gen->length > 0) {
+        float walker_r = 25.0f;
+        int2 head = gen->head;
+        int2 prev = head;
+        if(gen->length > 1) {
+            uint32_t c = gen->stack[gen->length - 2];
+            prev = (int2){c % maze->width, c / maze->width};
+        }
+        float2 walker_pos = {head.x * GRID_SIZE + h_g + h_l_t, head.y * GRID_SIZE + h_g + h_l_t};
+        float2 prev_walker_pos = {prev.x * GRID_SIZE + h_g + h_l_t, prev.y * GRID_SIZE + h_g + h_l_t};
 
-    drawCircle(walker_r, prev_walker_pos, (Color){200, 200, 100, 255});
-    drawCircle(walker_r, walker_pos, (Color){255, 0, 0, 255});
+        drawCircle(walker_r, prev_walker_pos, (Color){200, 200, 100, 255});
+        drawCircle(walker_r, walker_pos, (Color){255, 0, 0, 255});
+    }
 
+    sendQuadsToGPU();
     sendTrianglesToGPU();
 
     glfwSwapBuffers(window);
 }
 
-void gameLoop(GLFWwindow* window, maze* maze) {
-    double lastTime = glfwGetTime();
-
-    double time_elapsed = 0;
-    int step = 0;
-
-    int2 head = {-1, -1};
-    Walker walker = {head};
-    Walker prev_walker = {head};
-
-    Vector_int2 visited_pos;
-    init_vector_int2(&visited_pos);
-
-    bool backtrack_nearest = false;
+void gameLoop(GLFWwindow* window, maze* maze, DfsGenerator* gen, int cells_per_frame) {
     bool end_gen = false;
 
     while (!glfwWindowShouldClose(window)) {
-        double currentTime = glfwGetTime();
-        float deltaTime = (float)(currentTime - lastTime);
-        lastTime = currentTime;
-
-        time_elapsed += deltaTime;
-
         glfwPollEvents();
 
-        updateScene(deltaTime, &time_elapsed, maze, &step, &walker, &prev_walker, &visited_pos, &backtrack_nearest, &end_gen);
-        renderScene(window, maze, walker, prev_walker, &visited_pos);
+        updateScene(gen, cells_per_frame, &end_gen);
+        renderScene(window, maze, gen);
     }
 }
 
 
 int main(int argc, const char * argv[]) {
-    srand(time(NULL));
+    uint64_t seed = rng_time_seed();
+
+    int maze_width = MAZE_WITDH;
+    int maze_height = MAZE_HEIGHT;
+    int cells_per_frame = 1;
+    int thread_count = get_cpu_count();
+    bool headless = false;
+    bool benchmark = false;
+    bool solve_benchmark = false;
+    bool flood = false;
+    const char* heatmap_path = NULL;
+    MazeGenerator generator = GENERATOR_DFS;
+    const char* eller_path = NULL;
+    MazeFormat eller_format = MAZE_FORMAT_BINARY;
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--width") == 0 && i + 1 < argc) {
+            maze_width = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--height") == 0 && i + 1 < argc) {
+            maze_height = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--cells-per-frame") == 0 && i + 1 < argc) {
+            cells_per_frame = atoi(argv[++i]);
+            if(cells_per_frame < 1) cells_per_frame = 1;
+        } else if(strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        } else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--generator") == 0 && i + 1 < argc) {
+            i++;
+            int g = 0;
+            while(g < GENERATOR_COUNT && strcmp(argv[i], generator_names[g]) != 0) g++;
+            if(g == GENERATOR_COUNT) {
+                printf("Unknown generator: %s, using dfs\n", argv[i]);
+                g = GENERATOR_DFS;
+            }
+            generator = g;
+        } else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            thread_count = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--tile") == 0 && i + 1 < argc) {
+            tile_settings.size = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--benchmark") == 0) {
+            benchmark = true;
+        } else if(strcmp(argv[i], "--solver") == 0 && i + 1 < argc) {
+            i++;
+            int s = 0;
+            while(s < SOLVER_COUNT && strcmp(argv[i], solver_names[s]) != 0) s++;
+            if(s == SOLVER_COUNT) {
+                printf("Unknown solver: %s, using bfs\n", argv[i]);
+                s = SOLVER_BFS;
+            }
+            solver = s;
+        } else if(strcmp(argv[i], "--solve-benchmark") == 0) {
+            solve_benchmark = true;
+        } else if(strcmp(argv[i], "--render") == 0 && i + 1 < argc) {
+            i++;
+            if(strcmp(argv[i], "texture") == 0) {
+                textureRender = true;
+            } else if(strcmp(argv[i], "mesh") == 0) {
+                textureRender = false;
+            } else {
+                printf("Unknown render mode: %s, using mesh\n", argv[i]);
+            }
+        } else if(strcmp(argv[i], "--flood") == 0) {
+            flood = true;
+        } else if(strcmp(argv[i], "--heatmap") == 0 && i + 1 < argc) {
+            flood = true;
+            heatmap_path = argv[++i];
+        } else if(strcmp(argv[i], "--eller") == 0 && i + 1 < argc) {
+            eller_path = argv[++i];
+        } else if(strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            i++;
+            if(strcmp(argv[i], "ascii") == 0) {
+                eller_format = MAZE_FORMAT_ASCII;
+            } else if(strcmp(argv[i], "binary") == 0) {
+                eller_format = MAZE_FORMAT_BINARY;
+            } else {
+                fprintf(stderr, "Unknown format: %s, using binary\n", argv[i]);
+            }
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            printf("Usage: %s [--width W] [--height H] [--cells-per-frame N] [--headless] [--seed S]\n", argv[0]);
+            printf("       %*s [--generator dfs|kruskal|wilson|tiled] [--benchmark]\n", (int)strlen(argv[0]), "");
+            printf("       %*s [--threads N] [--tile N]\n", (int)strlen(argv[0]), "");
+            printf("       %*s [--solver bfs|astar|bidirectional|dead_end] [--solve-benchmark]\n", (int)strlen(argv[0]), "");
+            printf("       %*s [--flood] [--heatmap FILE.pgm] [--render mesh|texture]\n", (int)strlen(argv[0]), "");
+            printf("       %s --eller FILE [--format binary|ascii] [--width W] [--height H] [--seed S]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    rng_set_seed(seed);
+    Rng* rng = rng_local();
+    uint64_t gen_seed = ((uint64_t)rng_next(rng) << 32) | rng_next(rng);
+
+    // Streamed, there's no maze in memory for this one
+    if(eller_path) {
+        return runEller(eller_path, eller_format, maze_width, maze_height, gen_seed);
+    }
+
+    maze actual_maze;
+    if(!init_maze(&actual_maze, maze_width, maze_height)) {
+        return EXIT_FAILURE;
+    }
+
+    // Only the tiled generator uses it
+    initThreadPool(&threadPool, thread_count);
+    tile_settings.pool = &threadPool;
+
+    if(solve_benchmark || flood) {
+        int result = flood ? runFlood(&actual_maze, generator, gen_seed, heatmap_path)
+                           : runSolveBenchmark(&actual_maze, generator, gen_seed);
+        freeThreadPool(&threadPool);
+        free_maze(&actual_maze);
+        return result;
+    }
+
+    if(headless || benchmark) {
+        int result = benchmark ? runBenchmark(&actual_maze, gen_seed) : runHeadless(&actual_maze, generator, gen_seed);
+        freeThreadPool(&threadPool);
+        free_maze(&actual_maze);
+        return result;
+    }
 
+    printf("Seed: %llu\n", (unsigned long long)seed);
 
     GLFWwindow* window = initialize();
     initTriangleRenderer(&triangleVAO, &triangleVBO);
+    initQuadRenderer(&quadVAO, &quadVBO, &quadEBO);
 
     const char* vertSrc = load_file_as_string("Shaders/triangle_shader.vert");
     const char* fragSrc = load_file_as_string("Shaders/triangle_shader.frag");
 
     shaderProgram = createShaderProgram(vertSrc, fragSrc);
+    projectionLoc = glGetUniformLocation(shaderProgram, "uProjection");
+
+    // Zoomed out so the whole maze fits in the window
+    float maze_w = maze_width * GRID_SIZE + 10.0f;
+    float maze_h = maze_height * GRID_SIZE + 10.0f;
+    updateProjection((float2){0.0f, 0.0f}, fminf(WIDTH / maze_w, HEIGHT / maze_h));
 
     free((void*)vertSrc);
     free((void*)fragSrc);
 
-    maze actual_maze;
-    initialize_maze(&actual_maze);
+    // Big mazes fall back to the mesh if the GPU can't take a texture that size
+    textureRender = textureRender && init_maze_texture(&mazeTexture, &actual_maze);
+    if(textureRender) {
+        actual_maze.on_change = mark_texel_dirty;
+    } else {
+        init_maze_mesh(&mazeMesh, &actual_maze);
+        actual_maze.on_change = mark_cell_dirty;
+    }
+
+    // The DFS is carved a few cells per frame, the others are shown once they're done
+    DfsGenerator gen;
+    DfsGenerator* stepped = NULL;
+    maze_ends[0] = open_entrances(&actual_maze, &maze_ends[1]);
+    int2 entrance = maze_ends[0];
+    if(generator == GENERATOR_DFS) {
+        if(!init_dfs_generator(&gen, &actual_maze, entrance, gen_seed)) {
+            glfwTerminate();
+            freeThreadPool(&threadPool);
+            return EXIT_FAILURE;
+        }
+        stepped = &gen;
+    } else if(!gen_maze_with(generator, &actual_maze, entrance, gen_seed)) {
+        glfwTerminate();
+        freeThreadPool(&threadPool);
+        return EXIT_FAILURE;
+    } else {
+        showSolution(&actual_maze);
+    }
 
-    gameLoop(window, &actual_maze);
+    gameLoop(window, &actual_maze, stepped, cells_per_frame);
     glfwTerminate();
 
+    if(stepped) {
+        free_dfs_generator(stepped);
+    }
+
+    free_vector_Quad(&quadBuffer);
+    if(textureRender) {
+        free_maze_texture(&mazeTexture);
+    } else {
+        free_maze_mesh(&mazeMesh);
+    }
+    free_maze_solution(&solution);
+    freeThreadPool(&threadPool);
+    free_maze(&actual_maze);
 
     return EXIT_SUCCESS;
 }
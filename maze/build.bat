@@ -1,5 +1,5 @@
 cls
 
-gcc app.c utils.c -o maze.exe -lglfw3 -lglew32 -lopengl32 -lgdi32 -luser32 -lkernel32
+gcc -O2 app.c utils.c maze.c maze_gen.c maze_solve.c maze_flood.c eller.c rng.c threadpool.c -o maze.exe -lglfw3 -lglew32 -lopengl32 -lgdi32 -luser32 -lkernel32 -lpthread
 
 .\maze.exe
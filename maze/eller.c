@@ -0,0 +1,201 @@
+#include "eller.h"
+#include <string.h>
+
+#define LABEL_USED 1        // Some cell of the next row already carries this label
+#define LABEL_DOWN 2        // The set has a cell going down this row
+
+bool init_eller_generator(EllerGenerator* gen, int width, int height, uint64_t seed) {
+    memset(gen, 0, sizeof(*gen));
+    if(width <= 0 || height <= 0) {
+        fprintf(stderr, "Invalid maze size: %d x %d\n", width, height);
+        return false;
+    }
+
+    gen->width = width;
+    gen->height = height;
+    gen->labels = malloc(sizeof(uint32_t) * width);
+    gen->parent = malloc(sizeof(uint32_t) * width);
+    gen->count = malloc(sizeof(uint32_t) * width);
+    gen->candidate = malloc(sizeof(uint32_t) * width);
+    gen->flags = malloc(width);
+    gen->row_walls = malloc((width + 3) / 4);
+    if(!gen->labels || !gen->parent || !gen->count || !gen->candidate || !gen->flags || !gen->row_walls) {
+        fprintf(stderr, "Not enough memory for a %d wide maze\n", width);
+        free_eller_generator(gen);
+        return false;
+    }
+
+    // Every cell of the first row is its own set
+    for(int x = 0; x < width; x++) {
+        gen->labels[x] = x;
+        gen->parent[x] = x;
+    }
+    rng_seed(&gen->rng, seed, 0);
+    return true;
+}
+
+void free_eller_generator(EllerGenerator* gen) {
+    free(gen->labels);
+    free(gen->parent);
+    free(gen->count);
+    free(gen->candidate);
+    free(gen->flags);
+    free(gen->row_walls);
+    memset(gen, 0, sizeof(*gen));
+}
+
+static inline uint32_t find_label(uint32_t* parent, uint32_t l) {
+    while(parent[l] != l) {
+        parent[l] = parent[parent[l]];
+        l = parent[l];
+    }
+    return l;
+}
+
+static inline void open_row_wall(uint8_t* walls, int x, uint8_t wall) {
+    walls[x >> 2] &= ~(wall << ((x & 3) * 2));
+}
+
+static inline bool has_row_wall(uint8_t* walls, int x, uint8_t wall) {
+    return (walls[x >> 2] >> ((x & 3) * 2)) & wall;
+}
+
+// The coin flips make the branches here impossible to predict, so the passes below pick
+// with masks and selects instead of ifs. The random state lives in locals during a row,
+// the walls are bytes and a byte store would make the compiler reload it from gen every time
+bool next_eller_row(EllerGenerator* gen) {
+    if(gen->row >= gen->height) return false;
+
+    int width = gen->width;
+    uint32_t* labels = gen->labels;
+    uint32_t* parent = gen->parent;
+    uint32_t* count = gen->count;
+    uint32_t* candidate = gen->candidate;
+    uint8_t* flags = gen->flags;
+    uint8_t* walls = gen->row_walls;
+    bool last = gen->row == gen->height - 1;
+    Rng rng = gen->rng;
+    uint32_t bits = 0;      // 32 coin flips per rng_next
+
+    memset(walls, 0xFF, (width + 3) / 4);
+
+    // Join neighbours from different sets, on the last row all of them so everything is connected
+    uint32_t a = find_label(parent, labels[0]);
+    for(int x = 0; x + 1 < width; x++) {
+        if((x & 31) == 0) bits = rng_next(&rng);
+        uint32_t b = find_label(parent, labels[x + 1]);
+        uint8_t join = (a != b) & (last | ((bits >> (x & 31)) & 1));
+        walls[x >> 2] &= ~((join * WALL_RIGHT) << ((x & 3) * 2));
+        parent[b] = join ? a : b;
+        a = join ? a : b;
+    }
+
+    gen->row++;
+    if(last) {
+        gen->rng = rng;
+        return true;
+    }
+
+    // Every set goes down at least once. Random cells go down and if a set got none, the
+    // candidate does, picked uniformly from the set with reservoir sampling
+    for(int x = 0; x < width; x++) {
+        uint32_t r = find_label(parent, labels[x]);
+        labels[x] = r;
+        count[r] = 0;
+        flags[r] = 0;
+    }
+    for(int x = 0; x < width; x++) {
+        if((x & 31) == 0) bits = rng_next(&rng);
+        uint32_t r = labels[x];
+        uint8_t down = (bits >> (x & 31)) & 1;
+        candidate[r] = rng_below(&rng, ++count[r]) == 0 ? (uint32_t)x : candidate[r];
+        walls[x >> 2] &= ~((down * WALL_BOTTOM) << ((x & 3) * 2));
+        flags[r] |= down * LABEL_DOWN;
+    }
+    for(int x = 0; x < width; x++) {
+        uint32_t r = labels[x];
+        if(!(flags[r] & LABEL_DOWN)) {
+            open_row_wall(walls, candidate[r], WALL_BOTTOM);
+            flags[r] |= LABEL_DOWN;
+        }
+    }
+    gen->rng = rng;
+
+    // Next row: cells under an open wall keep the set, the others get a label nobody uses
+    memset(flags, 0, (unsigned)width);
+    for(int x = 0; x < width; x++) {
+        flags[labels[x]] |= !has_row_wall(walls, x, WALL_BOTTOM);
+    }
+    // The free labels go in count, it isn't needed anymore this row
+    uint32_t free_count = 0;
+    for(int l = 0; l < width; l++) {
+        count[free_count] = l;
+        free_count += !flags[l];
+        parent[l] = l;
+    }
+    uint32_t next_free = 0;
+    for(int x = 0; x < width; x++) {
+        uint32_t closed = has_row_wall(walls, x, WALL_BOTTOM);
+        labels[x] = closed ? count[next_free] : labels[x];
+        next_free += closed;
+    }
+
+    return true;
+}
+
+static bool write_u32(FILE* out, uint32_t v) {
+    uint8_t b[4] = {v & 0xFF, (v >> 8) & 0xFF, (v >> 16) & 0xFF, v >> 24};
+    return fwrite(b, 1, 4, out) == 4;
+}
+
+uint64_t write_eller_maze(FILE* out, MazeFormat format, int width, int height, uint64_t seed) {
+    EllerGenerator gen;
+    if(!init_eller_generator(&gen, width, height, seed)) return 0;
+
+    size_t row_bytes = format == MAZE_FORMAT_BINARY ? (size_t)(width + 3) / 4 : (size_t)width * 2 + 2;
+    char* line = malloc(row_bytes);
+    if(!line) {
+        free_eller_generator(&gen);
+        return 0;
+    }
+
+    uint64_t written = 0;
+    bool ok = true;
+
+    if(format == MAZE_FORMAT_BINARY) {
+        ok = fwrite("MAZE", 1, 4, out) == 4 && write_u32(out, width) && write_u32(out, height);
+        written += 12;
+    } else {
+        // Top border
+        for(int x = 0; x < width; x++) {
+            line[x * 2] = ' ';
+            line[x * 2 + 1] = '_';
+        }
+        line[width * 2] = '\n';
+        ok = fwrite(line, 1, width * 2 + 1, out) == (size_t)width * 2 + 1;
+        written += width * 2 + 1;
+    }
+
+    while(ok && next_eller_row(&gen)) {
+        if(format == MAZE_FORMAT_BINARY) {
+            ok = fwrite(gen.row_walls, 1, row_bytes, out) == row_bytes;
+        } else {
+            line[0] = '|';
+            for(int x = 0; x < width; x++) {
+                line[1 + x * 2] = has_row_wall(gen.row_walls, x, WALL_BOTTOM) ? '_' : ' ';
+                line[2 + x * 2] = has_row_wall(gen.row_walls, x, WALL_RIGHT) ? '|' : ' ';
+            }
+            line[row_bytes - 1] = '\n';
+            ok = fwrite(line, 1, row_bytes, out) == row_bytes;
+        }
+        written += row_bytes;
+    }
+
+    free(line);
+    free_eller_generator(&gen);
+    if(!ok) {
+        fprintf(stderr, "Failed writing the maze\n");
+        return 0;
+    }
+    return written;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <stdio.h>
+#include "rng.h"
+#include "maze.h"
+
+// Eller's algorithm, the maze comes out one row at a time and only the current row is kept,
+// so memory is O(width) no matter how tall the maze is
+
+typedef struct EllerGenerator {
+    int width;
+    int height;
+    int row;                // Next row to make
+
+    uint32_t* labels;       // Set of every cell of the current row, labels are in [0, width)
+    uint32_t* parent;       // Union-find over the labels, only lives for one row
+    uint32_t* count;        // Per set, for picking the cell that has to go down
+    uint32_t* candidate;
+    uint8_t* flags;         // Per label, LABEL_* bits
+
+    uint8_t* row_walls;     // Right and bottom walls of the row just made, packed like maze->walls
+    Rng rng;
+} EllerGenerator;
+
+bool init_eller_generator(EllerGenerator* gen, int width, int height, uint64_t seed);
+
+void free_eller_generator(EllerGenerator* gen);
+
+// Makes the next row into gen->row_walls, returns false once all height rows are done
+bool next_eller_row(EllerGenerator* gen);
+
+typedef enum MazeFormat {
+    MAZE_FORMAT_BINARY,     // "MAZE", width and height as uint32, then (width + 3) / 4 bytes per row
+    MAZE_FORMAT_ASCII       // A line per row, "_" for a bottom wall and "|" for a right wall
+} MazeFormat;
+
+// Generates the whole maze straight into out, returns the bytes written or 0 on error
+uint64_t write_eller_maze(FILE* out, MazeFormat format, int width, int height, uint64_t seed);
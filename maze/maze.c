@@ -0,0 +1,141 @@
+#include "maze.h"
+#include <stdio.h>
+#include <string.h>
+
+static size_t bitset_bytes(size_t bits) {
+    return (bits + 7) / 8;
+}
+
+bool init_maze(maze* maze, int width, int height) {
+    memset(maze, 0, sizeof(*maze));
+    if(width <= 0 || height <= 0) {
+        printf("Invalid maze size: %d x %d\n", width, height);
+        return false;
+    }
+
+    size_t cells = (size_t)width * height;
+    maze->width = width;
+    maze->height = height;
+    maze->walls = malloc((cells + 3) / 4);
+    maze->top_edge = malloc(bitset_bytes(width));
+    maze->left_edge = malloc(bitset_bytes(height));
+    maze->visited = malloc(((cells + 63) / 64) * sizeof(uint64_t));
+
+    if(!maze->walls || !maze->top_edge || !maze->left_edge || !maze->visited) {
+        printf("Not enough memory for a %d x %d maze\n", width, height);
+        free_maze(maze);
+        return false;
+    }
+
+    reset_maze(maze);
+    return true;
+}
+
+void free_maze(maze* maze) {
+    free(maze->walls);
+    free(maze->top_edge);
+    free(maze->left_edge);
+    free(maze->visited);
+    maze->walls = NULL;
+    maze->top_edge = NULL;
+    maze->left_edge = NULL;
+    maze->visited = NULL;
+}
+
+void reset_maze(maze* maze) {
+    size_t cells = (size_t)maze->width * maze->height;
+    memset(maze->walls, 0xFF, (cells + 3) / 4);
+    memset(maze->top_edge, 0xFF, bitset_bytes(maze->width));
+    memset(maze->left_edge, 0xFF, bitset_bytes(maze->height));
+    memset(maze->visited, 0, ((cells + 63) / 64) * sizeof(uint64_t));
+}
+
+size_t maze_memory_bytes(maze* maze) {
+    size_t cells = (size_t)maze->width * maze->height;
+    return (cells + 3) / 4 + bitset_bytes(maze->width) + bitset_bytes(maze->height) +
+           ((cells + 63) / 64) * sizeof(uint64_t);
+}
+
+void set_visited(maze* maze, int2 pos, bool value) {
+    size_t i = maze_index(maze, pos);
+    uint64_t bit = (uint64_t)1 << (i & 63);
+    if(value) { maze->visited[i >> 6] |= bit; } else { maze->visited[i >> 6] &= ~bit; }
+    if(maze->on_change) { maze->on_change(pos); }
+}
+
+static bool get_bit_at(uint8_t* bits, size_t i) {
+    return (bits[i >> 3] >> (i & 7)) & 1;
+}
+
+static void set_bit_at(uint8_t* bits, size_t i, bool value) {
+    uint8_t bit = 1U << (i & 7);
+    if(value) { bits[i >> 3] |= bit; } else { bits[i >> 3] &= ~bit; }
+}
+
+// Where the wall of pos in dir is stored, either a bit of walls or of one of the edge bitsets
+static uint8_t* wall_location(maze* maze, int2 pos, Direction dir, size_t* bit) {
+    switch(dir) {
+        case top:
+            if(pos.y == 0) { *bit = pos.x; return maze->top_edge; }
+            *bit = maze_index(maze, (int2){pos.x, pos.y - 1}) * 2 + 1;
+            return maze->walls;
+        case bottom:
+            *bit = maze_index(maze, pos) * 2 + 1;
+            return maze->walls;
+        case left:
+            if(pos.x == 0) { *bit = pos.y; return maze->left_edge; }
+            *bit = maze_index(maze, (int2){pos.x - 1, pos.y}) * 2;
+            return maze->walls;
+        case right:
+            *bit = maze_index(maze, pos) * 2;
+            return maze->walls;
+        default:
+            return NULL;
+    }
+}
+
+bool check_wall(maze* maze, int2 pos, Direction dir) {
+    size_t bit;
+    uint8_t* bits = wall_location(maze, pos, dir, &bit);
+    return bits && get_bit_at(bits, bit);
+}
+
+void set_wall_value(maze* maze, int2 pos, Direction dir, bool value) {
+    if(!is_point_in_maze(maze, pos)) {
+        printf("Invalid position passed: x:%d, y:%d\n", pos.x, pos.y);
+        printf("the position must not have the coords: width: %d, height: %d\n", maze->width, maze->height);
+        return;
+    }
+
+    size_t bit;
+    uint8_t* bits = wall_location(maze, pos, dir, &bit);
+    if(!bits) {
+        printf("Invalid direction passed: %d", dir);
+        return;
+    }
+    set_bit_at(bits, bit, value);
+
+    if(!maze->on_change) return;
+
+    int2 adyacent_pos = pos;
+    switch(dir) {
+        case top: adyacent_pos.y -= 1; break;
+        case bottom: adyacent_pos.y += 1; break;
+        case left: adyacent_pos.x -= 1; break;
+        case right: adyacent_pos.x += 1; break;
+        default: break;
+    }
+
+    maze->on_change(pos);
+    if(is_point_in_maze(maze, adyacent_pos)) {
+        maze->on_change(adyacent_pos);
+    }
+}
+
+void set_wall(maze* maze, int2 pos, Direction dir) {
+    set_wall_value(maze, pos, dir, true);
+}
+
+void clear_wall(maze* maze, int2 pos, Direction dir) {
+    set_wall_value(maze, pos, dir, false);
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Maze storage, sized at runtime
+// Every cell only keeps its right and bottom wall (2 bits, packed 4 cells per byte), the top
+// wall of a cell is the bottom wall of the one above and so on. The walls on the top and left
+// border don't belong to any cell so they get their own bitsets. Visited is a bitset too
+// 65536 x 65536 is ~1 GB of walls and 512 MB of visited bits
+
+typedef struct int2 {
+    int x;
+    int y;
+} int2;
+
+typedef enum Direction {
+    top,
+    bottom,
+    left,
+    right,
+    none
+} Direction;
+
+#define WALL_RIGHT 1
+#define WALL_BOTTOM 2
+
+typedef struct maze {
+    int width;
+    int height;
+    uint8_t* walls;         // Row major, cell (x, y) is y * width + x
+    uint8_t* top_edge;      // Top wall of row 0, one bit per column
+    uint8_t* left_edge;     // Left wall of column 0, one bit per row
+    uint64_t* visited;
+
+    // Called for every cell whose walls or visited bit changed, can be NULL
+    void (*on_change)(int2 pos);
+} maze;
+
+// All the walls set and nothing visited, returns false if the maze doesn't fit in memory
+bool init_maze(maze* maze, int width, int height);
+
+void free_maze(maze* maze);
+
+// Clears the visited bits and puts every wall back
+void reset_maze(maze* maze);
+
+// Bytes allocated for the walls, edges and visited bits
+size_t maze_memory_bytes(maze* maze);
+
+static inline size_t maze_index(maze* maze, int2 pos) {
+    return (size_t)pos.y * maze->width + pos.x;
+}
+
+static inline bool is_point_in_maze(maze* maze, int2 point) {
+    return point.x >= 0 && point.x < maze->width && point.y >= 0 && point.y < maze->height;
+}
+
+// Right and bottom bits of a cell
+static inline uint8_t get_cell_walls(maze* maze, size_t i) {
+    return (maze->walls[i >> 2] >> ((i & 3) * 2)) & 3;
+}
+
+static inline bool is_visited(maze* maze, int2 pos) {
+    size_t i = maze_index(maze, pos);
+    return (maze->visited[i >> 6] >> (i & 63)) & 1;
+}
+
+void set_visited(maze* maze, int2 pos, bool value);
+
+// Fast paths for the generators, they take the cell index and skip the bounds checks and on_change
+
+static inline bool is_visited_index(maze* maze, size_t i) {
+    return (maze->visited[i >> 6] >> (i & 63)) & 1;
+}
+
+static inline void set_visited_index(maze* maze, size_t i) {
+    maze->visited[i >> 6] |= (uint64_t)1 << (i & 63);
+}
+
+// Opens the wall between cell i and its neighbour in dir, which has to be inside the maze
+static inline void open_wall_index(maze* maze, size_t i, Direction dir) {
+    uint8_t wall = WALL_RIGHT;
+    switch(dir) {
+        case top: i -= maze->width; wall = WALL_BOTTOM; break;
+        case bottom: wall = WALL_BOTTOM; break;
+        case left: i -= 1; break;
+        default: break;
+    }
+    maze->walls[i >> 2] &= ~(wall << ((i & 3) * 2));
+}
+
+// Same as always, the wall of pos in dir, border walls included
+bool check_wall(maze* maze, int2 pos, Direction dir);
+
+// Sets or clears the wall between pos and its neighbour in dir
+void set_wall_value(maze* maze, int2 pos, Direction dir, bool value);
+
+void set_wall(maze* maze, int2 pos, Direction dir);
+
+void clear_wall(maze* maze, int2 pos, Direction dir);
@@ -0,0 +1,357 @@
+#include "maze_flood.h"
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define FLOOD_X86 1
+#include <immintrin.h>
+#endif
+
+bool init_flood_masks(FloodMasks* masks, maze* maze) {
+    memset(masks, 0, sizeof(*masks));
+
+    size_t row_words = ((size_t)maze->width + 63) / 64;
+    size_t words = row_words * maze->height;
+    masks->width = maze->width;
+    masks->height = maze->height;
+    masks->row_words = row_words;
+    masks->right = calloc(words, sizeof(uint64_t));
+    masks->down = calloc(words, sizeof(uint64_t));
+    if(!masks->right || !masks->down) {
+        printf("Not enough memory for the flood masks\n");
+        free_flood_masks(masks);
+        return false;
+    }
+
+    // A word at a time in registers, the wall bits are 1 for a wall so they get flipped
+    for(int y = 0; y < maze->height; y++) {
+        size_t i = (size_t)y * maze->width;
+        uint64_t* right = masks->right + y * row_words;
+        uint64_t* down = masks->down + y * row_words;
+        for(int x0 = 0; x0 < maze->width; x0 += 64) {
+            int n = maze->width - x0 < 64 ? maze->width - x0 : 64;
+            uint64_t r = 0;
+            uint64_t d = 0;
+            for(int b = 0; b < n; b++) {
+                uint8_t walls = ~get_cell_walls(maze, i + x0 + b);
+                r |= (uint64_t)(walls & WALL_RIGHT) << b;
+                d |= (uint64_t)((walls & WALL_BOTTOM) >> 1) << b;
+            }
+            right[x0 / 64] = r;
+            down[x0 / 64] = d;
+        }
+
+        // Entrances open the border, the flood stays inside
+        int last = maze->width - 1;
+        right[last / 64] &= ~((uint64_t)1 << (last & 63));
+    }
+    memset(masks->down + (maze->height - 1) * row_words, 0, row_words * sizeof(uint64_t));
+
+    return true;
+}
+
+void free_flood_masks(FloodMasks* masks) {
+    free(masks->right);
+    free(masks->down);
+    masks->right = NULL;
+    masks->down = NULL;
+}
+
+size_t flood_bitset_words(FloodMasks* masks) {
+    return masks->row_words * masks->height;
+}
+
+// Spreads g along the open walls in p inside one word, log steps instead of one shift per cell
+// After the step with shift k, p has bit x set if x can get to x + k in a straight line
+static inline uint64_t fill_right(uint64_t g, uint64_t p) {
+    g |= (g & p) << 1;  p &= p >> 1;
+    g |= (g & p) << 2;  p &= p >> 2;
+    g |= (g & p) << 4;  p &= p >> 4;
+    g |= (g & p) << 8;  p &= p >> 8;
+    g |= (g & p) << 16; p &= p >> 16;
+    g |= (g & p) << 32;
+    return g;
+}
+
+static inline uint64_t fill_left(uint64_t g, uint64_t p) {
+    g |= (g >> 1) & p;  p &= p >> 1;
+    g |= (g >> 2) & p;  p &= p >> 2;
+    g |= (g >> 4) & p;  p &= p >> 4;
+    g |= (g >> 8) & p;  p &= p >> 8;
+    g |= (g >> 16) & p; p &= p >> 16;
+    g |= (g >> 32) & p;
+    return g;
+}
+
+/* Row transfer, the bits of one row that go through the vertical walls into the next row */
+
+// dst |= src & gate over [begin, end), returns false if nothing changed, otherwise first and
+// last cover the words that did (they can cover a few more)
+typedef bool (*FloodTransferFn)(const uint64_t* src, const uint64_t* gate, uint64_t* dst,
+                                size_t begin, size_t end, size_t* first, size_t* last);
+
+static bool transferRowScalar(const uint64_t* src, const uint64_t* gate, uint64_t* dst,
+                              size_t begin, size_t end, size_t* first, size_t* last) {
+    bool changed = false;
+    for(size_t j = begin; j < end; j++) {
+        uint64_t t = src[j] & gate[j] & ~dst[j];
+        if(!t) continue;
+        dst[j] |= t;
+        if(!changed) *first = j;
+        *last = j;
+        changed = true;
+    }
+    return changed;
+}
+
+#ifdef FLOOD_X86
+
+// 256 cells at a time
+__attribute__((target("avx2")))
+static bool transferRowAVX2(const uint64_t* src, const uint64_t* gate, uint64_t* dst,
+                            size_t begin, size_t end, size_t* first, size_t* last) {
+    bool changed = false;
+    size_t j = begin;
+    for(; j + 4 <= end; j += 4) {
+        __m256i s = _mm256_loadu_si256((const __m256i*)(src + j));
+        __m256i g = _mm256_loadu_si256((const __m256i*)(gate + j));
+        __m256i d = _mm256_loadu_si256((const __m256i*)(dst + j));
+        __m256i t = _mm256_andnot_si256(d, _mm256_and_si256(s, g));
+        if(_mm256_testz_si256(t, t)) continue;
+
+        _mm256_storeu_si256((__m256i*)(dst + j), _mm256_or_si256(d, t));
+        if(!changed) *first = j;
+        *last = j + 3;
+        changed = true;
+    }
+
+    size_t tail_first = 0;
+    size_t tail_last = 0;
+    if(transferRowScalar(src, gate, dst, j, end, &tail_first, &tail_last)) {
+        if(!changed) *first = tail_first;
+        *last = tail_last;
+        changed = true;
+    }
+    return changed;
+}
+
+#endif
+
+static FloodTransferFn transferRowKernel = transferRowScalar;
+
+const char* init_flood_kernels() {
+#ifdef FLOOD_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        transferRowKernel = transferRowAVX2;
+        return "avx2";
+    }
+#endif
+    return "scalar";
+}
+
+/* Reachability */
+
+// Rows waiting to be filled, with the range of words that got new bits since the last time
+typedef struct FloodRows {
+    uint32_t* stack;
+    uint8_t* queued;
+    size_t* lo;
+    size_t* hi;
+    size_t length;
+} FloodRows;
+
+static inline void mark_row(FloodRows* rows, int y, size_t first, size_t last) {
+    if(!rows->queued[y]) {
+        rows->queued[y] = 1;
+        rows->lo[y] = first;
+        rows->hi[y] = last;
+        rows->stack[rows->length++] = (uint32_t)y;
+        return;
+    }
+    if(first < rows->lo[y]) rows->lo[y] = first;
+    if(last > rows->hi[y]) rows->hi[y] = last;
+}
+
+size_t flood_reachable(FloodMasks* masks, int2 start, uint64_t* reached) {
+    size_t row_words = masks->row_words;
+    size_t words = flood_bitset_words(masks);
+    memset(reached, 0, words * sizeof(uint64_t));
+
+    FloodRows rows;
+    rows.stack = malloc(sizeof(uint32_t) * masks->height);
+    rows.queued = calloc(masks->height, 1);
+    rows.lo = malloc(sizeof(size_t) * masks->height);
+    rows.hi = malloc(sizeof(size_t) * masks->height);
+    rows.length = 0;
+    if(!rows.stack || !rows.queued || !rows.lo || !rows.hi) {
+        printf("Not enough memory for the flood fill\n");
+        free(rows.stack);
+        free(rows.queued);
+        free(rows.lo);
+        free(rows.hi);
+        return 0;
+    }
+
+    size_t sw = (size_t)start.x / 64;
+    reached[start.y * row_words + sw] = (uint64_t)1 << (start.x & 63);
+    mark_row(&rows, start.y, sw, sw);
+
+    // Words outside a row's dirty range are already filled along the row, so each fill starts at
+    // the dirty range and only keeps going past it while a run carries into the next word
+    while(rows.length > 0) {
+        int y = rows.stack[--rows.length];
+        uint64_t* row = reached + y * row_words;
+        const uint64_t* open = masks->right + y * row_words;
+        size_t a = rows.lo[y];
+        size_t b = rows.hi[y];
+        rows.queued[y] = 0;
+
+        // Right, the carry is bit 0 of the next word
+        uint64_t carry = 0;
+        size_t last = b;
+        for(size_t j = a; j < row_words; j++) {
+            uint64_t g = fill_right(row[j] | carry, open[j]);
+            if(g != row[j] && j > last) last = j;
+            row[j] = g;
+            carry = (g & open[j]) >> 63;
+            if(j >= b && !carry) break;
+        }
+
+        // Left from the end of the right pass, the carry is bit 63 of the word before
+        size_t first = a;
+        carry = 0;
+        for(size_t j = last; ; j--) {
+            uint64_t g = fill_left(row[j] | carry, open[j]);
+            if(g != row[j] && j < first) first = j;
+            row[j] = g;
+            if(j == 0) break;
+            carry = (g & (open[j - 1] >> 63)) << 63;
+            if(j <= a && !carry) break;
+        }
+
+        size_t f, l;
+        if(y + 1 < masks->height &&
+           transferRowKernel(row, masks->down + y * row_words, row + row_words, first, last + 1, &f, &l)) {
+            mark_row(&rows, y + 1, f, l);
+        }
+        if(y > 0 &&
+           transferRowKernel(row, masks->down + (y - 1) * row_words, row - row_words, first, last + 1, &f, &l)) {
+            mark_row(&rows, y - 1, f, l);
+        }
+    }
+
+    free(rows.stack);
+    free(rows.queued);
+    free(rows.lo);
+    free(rows.hi);
+
+    size_t count = 0;
+    for(size_t k = 0; k < words; k++) {
+        count += __builtin_popcountll(reached[k]);
+    }
+    return count;
+}
+
+/* Distances */
+
+typedef struct FloodLayer {
+    uint64_t* visited;
+    uint64_t* next;         // Bits of the layer being built, zero outside of it
+    uint32_t* next_words;   // Words of next that aren't zero
+    size_t next_count;
+} FloodLayer;
+
+static inline void add_to_layer(FloodLayer* layer, size_t k, uint64_t bits) {
+    bits &= ~layer->visited[k];
+    if(!bits) return;
+    if(!layer->next[k]) layer->next_words[layer->next_count++] = (uint32_t)k;
+    layer->next[k] |= bits;
+}
+
+uint32_t flood_distances(FloodMasks* masks, int2 start, uint32_t* dist, size_t* reached_count) {
+    size_t row_words = masks->row_words;
+    size_t words = flood_bitset_words(masks);
+    size_t width = masks->width;
+    if(words > UINT32_MAX) {
+        printf("Maze too big for the flood distances\n");
+        return 0;
+    }
+
+    FloodLayer layer;
+    layer.visited = calloc(words, sizeof(uint64_t));
+    layer.next = calloc(words, sizeof(uint64_t));
+    layer.next_words = malloc(sizeof(uint32_t) * words);
+    layer.next_count = 0;
+    uint32_t* words_now = malloc(sizeof(uint32_t) * words);
+    uint64_t* bits_now = malloc(sizeof(uint64_t) * words);
+    if(!layer.visited || !layer.next || !layer.next_words || !words_now || !bits_now) {
+        printf("Not enough memory for the flood distances\n");
+        free(layer.visited);
+        free(layer.next);
+        free(layer.next_words);
+        free(words_now);
+        free(bits_now);
+        return 0;
+    }
+
+    if(dist) {
+        memset(dist, 0xFF, sizeof(uint32_t) * width * masks->height);
+        dist[(size_t)start.y * width + start.x] = 0;
+    }
+
+    size_t k0 = start.y * row_words + (size_t)start.x / 64;
+    words_now[0] = (uint32_t)k0;
+    bits_now[0] = (uint64_t)1 << (start.x & 63);
+    layer.visited[k0] = bits_now[0];
+    size_t count = 1;
+    size_t reached = 1;
+
+    uint32_t d = 0;
+    while(count > 0) {
+        // Every frontier word moves one step in all four directions at once
+        layer.next_count = 0;
+        for(size_t n = 0; n < count; n++) {
+            size_t k = words_now[n];
+            uint64_t bits = bits_now[n];
+            size_t j = k % row_words;
+            uint64_t open = masks->right[k];
+
+            add_to_layer(&layer, k, ((bits & open) << 1) | ((bits >> 1) & open));
+            if(j + 1 < row_words) add_to_layer(&layer, k + 1, (bits & open) >> 63);
+            if(j > 0) add_to_layer(&layer, k - 1, (bits & (masks->right[k - 1] >> 63)) << 63);
+            if(k + row_words < words) add_to_layer(&layer, k + row_words, bits & masks->down[k]);
+            if(k >= row_words) add_to_layer(&layer, k - row_words, bits & masks->down[k - row_words]);
+        }
+        if(layer.next_count == 0) break;
+        d++;
+
+        // The new layer becomes the frontier, next goes back to zero for the one after
+        count = layer.next_count;
+        for(size_t n = 0; n < count; n++) {
+            size_t k = layer.next_words[n];
+            uint64_t bits = layer.next[k];
+            layer.next[k] = 0;
+            layer.visited[k] |= bits;
+            words_now[n] = (uint32_t)k;
+            bits_now[n] = bits;
+            reached += __builtin_popcountll(bits);
+
+            if(!dist) continue;
+            size_t base = (k / row_words) * width + (k % row_words) * 64;
+            while(bits) {
+                dist[base + __builtin_ctzll(bits)] = d;
+                bits &= bits - 1;
+            }
+        }
+    }
+
+    free(layer.visited);
+    free(layer.next);
+    free(layer.next_words);
+    free(words_now);
+    free(bits_now);
+
+    if(reached_count) *reached_count = reached;
+    return d + 1;
+}
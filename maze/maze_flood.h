@@ -0,0 +1,35 @@
+#pragma once
+#include "maze.h"
+
+// Bit-parallel flood fill, 64 cells per word instead of one cell per queue entry
+// The packed walls are turned into two masks per row once (open to the right, open downwards),
+// then a whole corridor is filled with a few shifts and ands. Up to ~4 billion cells, 2 bits of
+// masks and 1 bit of reached cells each
+
+typedef struct FloodMasks {
+    int width;
+    int height;
+    size_t row_words;       // Words per row, rows start on a word so shifts never cross rows
+    uint64_t* right;        // Bit x of row y: the wall between (x, y) and (x + 1, y) is open
+    uint64_t* down;         // Bit x of row y: the wall between (x, y) and (x, y + 1) is open
+} FloodMasks;
+
+// Returns false if the masks don't fit in memory
+bool init_flood_masks(FloodMasks* masks, maze* maze);
+
+void free_flood_masks(FloodMasks* masks);
+
+// Rows of row_words words, enough for flood_reachable
+size_t flood_bitset_words(FloodMasks* masks);
+
+// Sets the bit of every cell reachable from start in reached (flood_bitset_words long, cleared
+// here) and returns how many there are
+size_t flood_reachable(FloodMasks* masks, int2 start, uint64_t* reached);
+
+// BFS one layer at a time, the frontier is a list of the words that have frontier bits in them
+// dist gets the steps from start for every cell (UINT32_MAX if unreachable), it can be NULL when
+// only the counts are needed. Returns the layers, which is the largest distance + 1
+uint32_t flood_distances(FloodMasks* masks, int2 start, uint32_t* dist, size_t* reached_count);
+
+// Picks the AVX2 row transfer if the CPU has it, returns the name of the one in use
+const char* init_flood_kernels();
@@ -0,0 +1,484 @@
+#include "maze_gen.h"
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+
+const char* generator_names[GENERATOR_COUNT] = {
+    "dfs",
+    "kruskal",
+    "wilson",
+    "tiled"
+};
+
+TileSettings tile_settings = {
+    256,    // size
+    NULL    // pool
+};
+
+static const int dir_x[4] = {0, 0, -1, 1};
+static const int dir_y[4] = {-1, 1, 0, 0};
+
+// nth_set_bit[mask][k] is the position of the k-th set bit of mask, a lookup instead of a
+// loop and a switch keeps the hot path free of branches that depend on the random pick
+static const uint8_t nth_set_bit[16][4] = {
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {1, 0, 0, 0},
+    {0, 1, 0, 0},
+    {2, 0, 0, 0},
+    {0, 2, 0, 0},
+    {1, 2, 0, 0},
+    {0, 1, 2, 0},
+    {3, 0, 0, 0},
+    {0, 3, 0, 0},
+    {1, 3, 0, 0},
+    {0, 1, 3, 0},
+    {2, 3, 0, 0},
+    {0, 2, 3, 0},
+    {1, 2, 3, 0},
+    {0, 1, 2, 3},
+};
+
+// Bits set in a 4 bit mask, looked up in a nibble table (__builtin_popcount is a call without -mpopcnt)
+static inline unsigned mask_bits(unsigned mask) {
+    return (0x4332322132212110ULL >> (mask * 4)) & 0xF;
+}
+
+bool init_dfs_generator(DfsGenerator* gen, maze* maze, int2 start, uint64_t seed) {
+    memset(gen, 0, sizeof(*gen));
+
+    size_t cells = (size_t)maze->width * maze->height;
+    if(cells - 1 > UINT32_MAX) {
+        printf("Maze too big for the DFS generator: %d x %d\n", maze->width, maze->height);
+        return false;
+    }
+    if(!is_point_in_maze(maze, start)) {
+        printf("Invalid start for the DFS generator: x:%d, y:%d\n", start.x, start.y);
+        return false;
+    }
+
+    gen->maze = maze;
+    gen->stack = malloc(cells * sizeof(uint32_t));
+    gen->finished = calloc((cells + 63) / 64, sizeof(uint64_t));
+    if(!gen->stack || !gen->finished) {
+        printf("Not enough memory for the DFS generator\n");
+        free_dfs_generator(gen);
+        return false;
+    }
+
+    rng_seed(&gen->rng, seed, 0);
+
+    size_t i = maze_index(maze, start);
+    gen->stack[0] = (uint32_t)i;
+    gen->length = 1;
+    gen->head = start;
+    set_visited_index(maze, i);
+    if(maze->on_change) { maze->on_change(start); }
+
+    return true;
+}
+
+void free_dfs_generator(DfsGenerator* gen) {
+    free(gen->stack);
+    free(gen->finished);
+    gen->stack = NULL;
+    gen->finished = NULL;
+    gen->length = 0;
+}
+
+bool step_dfs_generator(DfsGenerator* gen, size_t budget) {
+    // The head and the stack stay in locals, gen is only written back at the end
+    maze* maze = gen->maze;
+    uint32_t* stack = gen->stack;
+    size_t length = gen->length;
+    size_t width = maze->width;
+    int max_x = maze->width - 1;
+    int max_y = maze->height - 1;
+    void (*on_change)(int2 pos) = maze->on_change;
+    const ptrdiff_t step[4] = {-(ptrdiff_t)width, (ptrdiff_t)width, -1, 1};
+
+    int x = gen->head.x;
+    int y = gen->head.y;
+    size_t i = length > 0 ? stack[length - 1] : 0;
+
+    while(budget-- > 0 && length > 0) {
+        // One bit per Direction for the neighbours nobody visited yet
+        unsigned mask = 0;
+        if(y > 0 && !is_visited_index(maze, i - width)) mask |= 1 << top;
+        if(y < max_y && !is_visited_index(maze, i + width)) mask |= 1 << bottom;
+        if(x > 0 && !is_visited_index(maze, i - 1)) mask |= 1 << left;
+        if(x < max_x && !is_visited_index(maze, i + 1)) mask |= 1 << right;
+
+        if(mask) {
+            // Every open neighbour is as likely, pick the k-th set bit
+            Direction dir = (Direction)nth_set_bit[mask][rng_below(&gen->rng, mask_bits(mask))];
+
+            size_t next = i + step[dir];
+            open_wall_index(maze, i, dir);
+            set_visited_index(maze, next);
+            stack[length++] = (uint32_t)next;
+
+            if(on_change) {
+                on_change((int2){x, y});
+                on_change((int2){x + dir_x[dir], y + dir_y[dir]});
+            }
+            x += dir_x[dir];
+            y += dir_y[dir];
+            i = next;
+        } else {
+            // Dead end, back to the previous cell of the path
+            gen->finished[i >> 6] |= (uint64_t)1 << (i & 63);
+            if(on_change) { on_change((int2){x, y}); }
+
+            length--;
+            if(length == 0) break;
+
+            // Neighbours on the stack are one cell apart, no division needed to get x and y
+            size_t prev = stack[length - 1];
+            int vertical = prev == i - width || prev == i + width;
+            int sign = (prev > i) - (prev < i);
+            y += vertical * sign;
+            x += !vertical * sign;
+            i = prev;
+        }
+    }
+
+    gen->length = length;
+    gen->head = (int2){x, y};
+    return length > 0;
+}
+
+bool gen_maze_dfs(maze* maze, int2 start, uint64_t seed) {
+    DfsGenerator gen;
+    if(!init_dfs_generator(&gen, maze, start, seed)) return false;
+
+    step_dfs_generator(&gen, SIZE_MAX);
+
+    free_dfs_generator(&gen);
+    return true;
+}
+
+bool init_disjoint_set(DisjointSet* set, size_t count) {
+    set->count = count;
+    set->parent = malloc(sizeof(uint32_t) * count);
+    set->rank = calloc(count, 1);
+    if(!set->parent || !set->rank) {
+        free_disjoint_set(set);
+        return false;
+    }
+    for(size_t i = 0; i < count; i++) {
+        set->parent[i] = (uint32_t)i;
+    }
+    return true;
+}
+
+void free_disjoint_set(DisjointSet* set) {
+    free(set->parent);
+    free(set->rank);
+    set->parent = NULL;
+    set->rank = NULL;
+    set->count = 0;
+}
+
+// The generators below carve the whole maze, so it all counts as visited for the renderer
+static void mark_all_visited(maze* maze) {
+    size_t cells = (size_t)maze->width * maze->height;
+    memset(maze->visited, 0xFF, (cells + 63) / 64 * sizeof(uint64_t));
+}
+
+bool gen_maze_kruskal(maze* maze, uint64_t seed) {
+    size_t cells = (size_t)maze->width * maze->height;
+    if(cells > (size_t)INT32_MAX) {
+        printf("Maze too big for the Kruskal generator: %d x %d\n", maze->width, maze->height);
+        return false;
+    }
+
+    // Edge e is the right wall of cell e / 2 if e is even, the bottom wall if it's odd
+    uint32_t* edges = malloc(sizeof(uint32_t) * cells * 2);
+    DisjointSet set;
+    if(!edges || !init_disjoint_set(&set, cells)) {
+        printf("Not enough memory for the Kruskal generator\n");
+        free(edges);
+        return false;
+    }
+
+    size_t edge_count = 0;
+    for(int y = 0; y < maze->height; y++) {
+        for(int x = 0; x < maze->width; x++) {
+            uint32_t c = (uint32_t)((size_t)y * maze->width + x);
+            if(x + 1 < maze->width) edges[edge_count++] = c * 2;
+            if(y + 1 < maze->height) edges[edge_count++] = c * 2 + 1;
+        }
+    }
+
+    // Fisher-Yates, but each edge is used as soon as it's drawn instead of shuffling first
+    Rng rng;
+    rng_seed(&rng, seed, 0);
+    size_t joined = 0;
+    for(size_t k = 0; k < edge_count && joined + 1 < cells; k++) {
+        size_t j = k + rng_below(&rng, (uint32_t)(edge_count - k));
+        uint32_t e = edges[j];
+        edges[j] = edges[k];
+
+        uint32_t c = e >> 1;
+        bool is_bottom = e & 1;
+        uint32_t n = is_bottom ? c + maze->width : c + 1;
+        if(union_sets(&set, c, n)) {
+            open_wall_index(maze, c, is_bottom ? bottom : right);
+            joined++;
+        }
+    }
+
+    mark_all_visited(maze);
+    free_disjoint_set(&set);
+    free(edges);
+    return true;
+}
+
+bool gen_maze_wilson(maze* maze, uint64_t seed) {
+    size_t cells = (size_t)maze->width * maze->height;
+    size_t width = maze->width;
+    int max_x = maze->width - 1;
+    int max_y = maze->height - 1;
+
+    // Direction each cell of the current walk left through. A walk that crosses itself just
+    // overwrites it, which is the loop erasing
+    uint8_t* walk_dir = malloc(cells);
+    if(!walk_dir) {
+        printf("Not enough memory for the Wilson generator\n");
+        return false;
+    }
+
+    Rng rng;
+    rng_seed(&rng, seed, 0);
+    const ptrdiff_t step[4] = {-(ptrdiff_t)width, (ptrdiff_t)width, -1, 1};
+
+    // The tree (the visited cells) starts as one random cell
+    int2 root = {(int)rng_below(&rng, maze->width), (int)rng_below(&rng, maze->height)};
+    set_visited_index(maze, maze_index(maze, root));
+
+    for(int sy = 0; sy < maze->height; sy++) {
+        for(int sx = 0; sx < maze->width; sx++) {
+            size_t start = (size_t)sy * width + sx;
+            if(is_visited_index(maze, start)) continue;
+
+            // Random walk until it hits the tree
+            size_t i = start;
+            int x = sx;
+            int y = sy;
+            while(!is_visited_index(maze, i)) {
+                unsigned mask = ((y > 0) << top) | ((y < max_y) << bottom) | ((x > 0) << left) | ((x < max_x) << right);
+                Direction dir = (Direction)nth_set_bit[mask][rng_below(&rng, mask_bits(mask))];
+                walk_dir[i] = dir;
+                i += step[dir];
+                x += dir_x[dir];
+                y += dir_y[dir];
+            }
+
+            // Follow the last exit of every cell from the start, that's the walk without its loops
+            i = start;
+            while(!is_visited_index(maze, i)) {
+                Direction dir = (Direction)walk_dir[i];
+                set_visited_index(maze, i);
+                open_wall_index(maze, i, dir);
+                i += step[dir];
+            }
+        }
+    }
+
+    free(walk_dir);
+    return true;
+}
+
+typedef struct TileJob {
+    maze* maze;
+    uint64_t seed;
+    int size;
+    int tiles_x;
+    uint32_t** stacks;      // One stack and visited bitset per worker, size * size cells each
+    uint64_t** visited;
+} TileJob;
+
+// Same DFS as step_dfs_generator but inside one tile, with visited bits of its own. Walls are
+// shared with the neighbour tiles (4 cells per byte), so they're cleared with an atomic and
+static void carve_tile(TileJob* job, int tile, int worker) {
+    maze* maze = job->maze;
+    int x0 = (tile % job->tiles_x) * job->size;
+    int y0 = (tile / job->tiles_x) * job->size;
+    int w = maze->width - x0 < job->size ? maze->width - x0 : job->size;
+    int h = maze->height - y0 < job->size ? maze->height - y0 : job->size;
+    size_t tile_cells = (size_t)w * h;
+
+    uint32_t* stack = job->stacks[worker];
+    uint64_t* visited = job->visited[worker];
+    memset(visited, 0, (tile_cells + 63) / 64 * sizeof(uint64_t));
+
+    Rng rng;
+    rng_seed(&rng, job->seed, tile);
+    const ptrdiff_t step[4] = {-w, w, -1, 1};
+
+    int x = rng_below(&rng, w);
+    int y = rng_below(&rng, h);
+    size_t i = (size_t)y * w + x;
+    visited[i >> 6] |= (uint64_t)1 << (i & 63);
+    size_t length = 0;
+    stack[length++] = (uint32_t)i;
+
+    while(length > 0) {
+        unsigned mask = 0;
+        if(y > 0 && !((visited[(i - w) >> 6] >> ((i - w) & 63)) & 1)) mask |= 1 << top;
+        if(y < h - 1 && !((visited[(i + w) >> 6] >> ((i + w) & 63)) & 1)) mask |= 1 << bottom;
+        if(x > 0 && !((visited[(i - 1) >> 6] >> ((i - 1) & 63)) & 1)) mask |= 1 << left;
+        if(x < w - 1 && !((visited[(i + 1) >> 6] >> ((i + 1) & 63)) & 1)) mask |= 1 << right;
+
+        if(mask) {
+            Direction dir = (Direction)nth_set_bit[mask][rng_below(&rng, mask_bits(mask))];
+
+            // Right or bottom wall of the cell on the top / left side of the move
+            int wx = x0 + x + (dir == left ? -1 : 0);
+            int wy = y0 + y + (dir == top ? -1 : 0);
+            size_t g = (size_t)wy * maze->width + wx;
+            uint8_t wall = dir == top || dir == bottom ? WALL_BOTTOM : WALL_RIGHT;
+            __atomic_fetch_and(&maze->walls[g >> 2], (uint8_t)~(wall << ((g & 3) * 2)), __ATOMIC_RELAXED);
+
+            i += step[dir];
+            x += dir_x[dir];
+            y += dir_y[dir];
+            visited[i >> 6] |= (uint64_t)1 << (i & 63);
+            stack[length++] = (uint32_t)i;
+        } else {
+            length--;
+            if(length == 0) break;
+
+            size_t prev = stack[length - 1];
+            int vertical = prev == i - w || prev == i + w;
+            int sign = (prev > i) - (prev < i);
+            y += vertical * sign;
+            x += !vertical * sign;
+            i = prev;
+        }
+    }
+}
+
+static void carveTilesJob(void* ctx, int begin, int end, int worker) {
+    TileJob* job = (TileJob*)ctx;
+    for(int t = begin; t < end; t++) {
+        carve_tile(job, t, worker);
+    }
+}
+
+bool gen_maze_tiled(maze* maze, uint64_t seed) {
+    int size = tile_settings.size;
+    ThreadPool* pool = tile_settings.pool;
+    int workers = pool ? pool->count : 1;
+
+    if(size < 1 || (size_t)size * size - 1 > UINT32_MAX) {
+        printf("Invalid tile size: %d\n", size);
+        return false;
+    }
+
+    int tiles_x = (maze->width + size - 1) / size;
+    int tiles_y = (maze->height + size - 1) / size;
+    size_t tiles = (size_t)tiles_x * tiles_y;
+    if(tiles > INT32_MAX) {
+        printf("Too many tiles: %zu, use a bigger --tile\n", tiles);
+        return false;
+    }
+
+    size_t tile_cells = (size_t)size * size;
+    TileJob job = {maze, seed, size, tiles_x, NULL, NULL};
+    job.stacks = calloc(workers, sizeof(uint32_t*));
+    job.visited = calloc(workers, sizeof(uint64_t*));
+    uint32_t* pairs = malloc(sizeof(uint32_t) * tiles * 2);
+    DisjointSet set = {NULL, NULL, 0};
+
+    bool ok = job.stacks && job.visited && pairs && init_disjoint_set(&set, tiles);
+    for(int k = 0; ok && k < workers; k++) {
+        job.stacks[k] = malloc(sizeof(uint32_t) * tile_cells);
+        job.visited[k] = malloc((tile_cells + 63) / 64 * sizeof(uint64_t));
+        ok = job.stacks[k] && job.visited[k];
+    }
+
+    if(ok) {
+        if(pool) {
+            parallelFor(pool, (int)tiles, carveTilesJob, &job);
+        } else {
+            carveTilesJob(&job, 0, (int)tiles, 0);
+        }
+
+        // Seams: pair 2t joins tile t with the one on its right, 2t + 1 with the one below.
+        // Random order, and every pair that joins two sets gets one random opening. Stream
+        // tiles so it doesn't repeat any tile's numbers
+        size_t pair_count = 0;
+        for(size_t t = 0; t < tiles; t++) {
+            if((int)(t % tiles_x) + 1 < tiles_x) pairs[pair_count++] = (uint32_t)(t * 2);
+            if((int)(t / tiles_x) + 1 < tiles_y) pairs[pair_count++] = (uint32_t)(t * 2 + 1);
+        }
+
+        Rng rng;
+        rng_seed(&rng, seed, tiles);
+        for(size_t k = 0; k < pair_count; k++) {
+            size_t j = k + rng_below(&rng, (uint32_t)(pair_count - k));
+            uint32_t p = pairs[j];
+            pairs[j] = pairs[k];
+
+            uint32_t t = p >> 1;
+            bool below = p & 1;
+            if(!union_sets(&set, t, below ? t + tiles_x : t + 1)) continue;
+
+            int x0 = (t % tiles_x) * size;
+            int y0 = (t / tiles_x) * size;
+            int w = maze->width - x0 < size ? maze->width - x0 : size;
+            int h = maze->height - y0 < size ? maze->height - y0 : size;
+            if(below) {
+                int2 pos = {x0 + (int)rng_below(&rng, w), y0 + h - 1};
+                open_wall_index(maze, maze_index(maze, pos), bottom);
+            } else {
+                int2 pos = {x0 + w - 1, y0 + (int)rng_below(&rng, h)};
+                open_wall_index(maze, maze_index(maze, pos), right);
+            }
+        }
+
+        mark_all_visited(maze);
+    } else {
+        printf("Not enough memory for the tiled generator\n");
+    }
+
+    for(int k = 0; k < workers && job.stacks && job.visited; k++) {
+        free(job.stacks[k]);
+        free(job.visited[k]);
+    }
+    free(job.stacks);
+    free(job.visited);
+    free(pairs);
+    free_disjoint_set(&set);
+    return ok;
+}
+
+bool gen_maze_with(MazeGenerator generator, maze* maze, int2 start, uint64_t seed) {
+    switch(generator) {
+        case GENERATOR_DFS: return gen_maze_dfs(maze, start, seed);
+        case GENERATOR_KRUSKAL: return gen_maze_kruskal(maze, seed);
+        case GENERATOR_WILSON: return gen_maze_wilson(maze, seed);
+        case GENERATOR_TILED: return gen_maze_tiled(maze, seed);
+        default:
+            printf("Invalid generator: %d\n", generator);
+            return false;
+    }
+}
+
+size_t generator_bytes(MazeGenerator generator, size_t cells) {
+    switch(generator) {
+        case GENERATOR_DFS: return cells * sizeof(uint32_t) + (cells + 63) / 64 * sizeof(uint64_t);
+        case GENERATOR_KRUSKAL: return cells * 2 * sizeof(uint32_t) + cells * (sizeof(uint32_t) + 1);
+        case GENERATOR_WILSON: return cells;
+        case GENERATOR_TILED: {
+            size_t tile_cells = (size_t)tile_settings.size * tile_settings.size;
+            size_t workers = tile_settings.pool ? tile_settings.pool->count : 1;
+            size_t tiles = cells / tile_cells + 1;
+            return workers * (tile_cells * sizeof(uint32_t) + (tile_cells + 63) / 64 * sizeof(uint64_t)) +
+                   tiles * (2 * sizeof(uint32_t) + sizeof(uint32_t) + 1);
+        }
+        default: return 0;
+    }
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include "maze.h"
+#include "rng.h"
+#include "threadpool.h"
+
+// Maze generators, they all carve a maze that starts with every wall set (init_maze / reset_maze)
+
+typedef enum MazeGenerator {
+    GENERATOR_DFS,
+    GENERATOR_KRUSKAL,
+    GENERATOR_WILSON,
+    GENERATOR_TILED,
+    GENERATOR_COUNT
+} MazeGenerator;
+
+extern const char* generator_names[GENERATOR_COUNT];
+
+// Disjoint sets over a flat array, path compression and union by rank
+typedef struct DisjointSet {
+    uint32_t* parent;
+    uint8_t* rank;
+    size_t count;
+} DisjointSet;
+
+bool init_disjoint_set(DisjointSet* set, size_t count);
+
+void free_disjoint_set(DisjointSet* set);
+
+static inline uint32_t find_set(DisjointSet* set, uint32_t x) {
+    uint32_t root = x;
+    while(set->parent[root] != root) root = set->parent[root];
+    // Second pass points the whole path at the root
+    while(set->parent[x] != root) {
+        uint32_t next = set->parent[x];
+        set->parent[x] = root;
+        x = next;
+    }
+    return root;
+}
+
+// Returns false if a and b were already in the same set
+static inline bool union_sets(DisjointSet* set, uint32_t a, uint32_t b) {
+    a = find_set(set, a);
+    b = find_set(set, b);
+    if(a == b) return false;
+
+    if(set->rank[a] < set->rank[b]) { uint32_t t = a; a = b; b = t; }
+    set->parent[b] = a;
+    if(set->rank[a] == set->rank[b]) set->rank[a]++;
+    return true;
+}
+
+// Recursive backtracker (randomized DFS) with an explicit stack instead of recursion
+// It can run in one go or a few cells at a time so the window can show it being carved
+typedef struct DfsGenerator {
+    maze* maze;
+    uint32_t* stack;        // Cell indices of the current path, the top is the head
+    size_t length;
+    int2 head;
+    uint64_t* finished;     // Cells that got popped off the stack
+    Rng rng;
+} DfsGenerator;
+
+// Mazes up to 2^32 cells, returns false if the stack doesn't fit in memory
+bool init_dfs_generator(DfsGenerator* gen, maze* maze, int2 start, uint64_t seed);
+
+void free_dfs_generator(DfsGenerator* gen);
+
+// Moves the head up to budget times (one push or pop each), returns false when the maze is done
+bool step_dfs_generator(DfsGenerator* gen, size_t budget);
+
+static inline bool is_cell_finished(DfsGenerator* gen, size_t i) {
+    return (gen->finished[i >> 6] >> (i & 63)) & 1;
+}
+
+// Generates the whole maze in one go
+bool gen_maze_dfs(maze* maze, int2 start, uint64_t seed);
+
+// Randomized Kruskal, every inner wall in random order and opened if it joins two sets
+// Needs 2^31 cells at most
+bool gen_maze_kruskal(maze* maze, uint64_t seed);
+
+// Wilson, loop-erased random walks into the tree so far. Every perfect maze is as likely
+bool gen_maze_wilson(maze* maze, uint64_t seed);
+
+// The maze is cut in size x size tiles. Every tile gets its own DFS, seeded by its index, and the
+// tiles are spread over the pool. Then a union-find over the tiles opens one random wall on the
+// seam of each pair of neighbour tiles it joins, so the result is one tree again
+// The maze only depends on the seed and size, not on the number of threads
+typedef struct TileSettings {
+    int size;
+    ThreadPool* pool;       // NULL runs every tile on the calling thread
+} TileSettings;
+
+extern TileSettings tile_settings;
+
+bool gen_maze_tiled(maze* maze, uint64_t seed);
+
+// Runs generator to completion, start is only used by the DFS. No on_change calls for
+// Kruskal and Wilson, they touch every cell anyway
+bool gen_maze_with(MazeGenerator generator, maze* maze, int2 start, uint64_t seed);
+
+// Memory a generator needs on top of the maze itself
+size_t generator_bytes(MazeGenerator generator, size_t cells);
@@ -0,0 +1,444 @@
+#include "maze_solve.h"
+#include <stdio.h>
+#include <string.h>
+
+const char* solver_names[SOLVER_COUNT] = {
+    "bfs",
+    "astar",
+    "bidirectional",
+    "dead_end"
+};
+
+#define UNSEEN UINT32_MAX
+
+// Open sides of cell i as a mask of 1 << Direction. Same answer as check_wall on the four sides,
+// except the border always counts as closed so the entrances don't lead out of the maze
+static inline unsigned open_dirs(maze* maze, size_t i) {
+    size_t width = maze->width;
+    size_t y = i / width;
+    size_t x = i - y * width;
+    uint8_t walls = get_cell_walls(maze, i);
+
+    unsigned mask = 0;
+    if(y > 0 && !(get_cell_walls(maze, i - width) & WALL_BOTTOM)) mask |= 1 << top;
+    if(y + 1 < (size_t)maze->height && !(walls & WALL_BOTTOM)) mask |= 1 << bottom;
+    if(x > 0 && !(get_cell_walls(maze, i - 1) & WALL_RIGHT)) mask |= 1 << left;
+    if(x + 1 < width && !(walls & WALL_RIGHT)) mask |= 1 << right;
+    return mask;
+}
+
+static inline size_t neighbour(maze* maze, size_t i, Direction dir) {
+    switch(dir) {
+        case top: return i - maze->width;
+        case bottom: return i + maze->width;
+        case left: return i - 1;
+        default: return i + 1;
+    }
+}
+
+static inline unsigned manhattan(maze* maze, size_t i, int2 goal) {
+    int y = (int)(i / maze->width);
+    int x = (int)(i - (size_t)y * maze->width);
+    return abs(x - goal.x) + abs(y - goal.y);
+}
+
+// Checks the sizes and sets up an empty solution
+static bool begin_solution(maze* maze, int2 start, int2 goal, MazeSolution* solution, const char* name) {
+    memset(solution, 0, sizeof(*solution));
+
+    size_t cells = (size_t)maze->width * maze->height;
+    if(cells > (size_t)INT32_MAX) {
+        printf("Maze too big for the %s solver: %d x %d\n", name, maze->width, maze->height);
+        return false;
+    }
+    if(!is_point_in_maze(maze, start) || !is_point_in_maze(maze, goal)) {
+        printf("Start or goal outside the maze\n");
+        return false;
+    }
+
+    solution->on_path = calloc((cells + 63) / 64, sizeof(uint64_t));
+    if(!solution->on_path) {
+        printf("Not enough memory for the %s solver\n", name);
+        return false;
+    }
+    return true;
+}
+
+// Walks back from cell to a neighbour one step closer to from until it gets there, writing
+// path[dist[cell]] down to path[0]. Every distance is the length of a real path to from, so there
+// is always a neighbour one closer and the walk can't get stuck
+static void trace_back(maze* maze, const uint32_t* dist, size_t cell, uint32_t* path) {
+    for(;;) {
+        path[dist[cell]] = (uint32_t)cell;
+        if(dist[cell] == 0) break;
+
+        unsigned mask = open_dirs(maze, cell);
+        for(int d = 0; d < 4; d++) {
+            if(!(mask & (1 << d))) continue;
+            size_t n = neighbour(maze, cell, (Direction)d);
+            if(dist[n] == dist[cell] - 1) { cell = n; break; }
+        }
+    }
+}
+
+// Path from start to goal out of the distances from start, goal must have been reached
+static bool path_from_dist(maze* maze, const uint32_t* dist, size_t goal, MazeSolution* solution) {
+    solution->length = (size_t)dist[goal] + 1;
+    solution->path = malloc(sizeof(uint32_t) * solution->length);
+    if(!solution->path) {
+        printf("Not enough memory for the path\n");
+        return false;
+    }
+
+    trace_back(maze, dist, goal, solution->path);
+    for(size_t k = 0; k < solution->length; k++) {
+        uint32_t c = solution->path[k];
+        solution->on_path[c >> 6] |= (uint64_t)1 << (c & 63);
+    }
+    return true;
+}
+
+bool solve_maze_bfs(maze* maze, int2 start, int2 goal, MazeSolution* solution) {
+    if(!begin_solution(maze, start, goal, solution, "BFS")) return false;
+
+    size_t cells = (size_t)maze->width * maze->height;
+    uint32_t* dist = malloc(sizeof(uint32_t) * cells);
+    uint32_t* queue = malloc(sizeof(uint32_t) * cells);
+    if(!dist || !queue) {
+        printf("Not enough memory for the BFS solver\n");
+        free(dist);
+        free(queue);
+        free_maze_solution(solution);
+        return false;
+    }
+    solution->scratch_bytes = sizeof(uint32_t) * cells * 2;
+
+    memset(dist, 0xFF, sizeof(uint32_t) * cells);
+    size_t s = maze_index(maze, start);
+    size_t g = maze_index(maze, goal);
+    dist[s] = 0;
+    queue[0] = (uint32_t)s;
+
+    // Every cell goes in the queue once, so it never wraps
+    size_t head = 0;
+    size_t tail = 1;
+    while(head < tail) {
+        size_t c = queue[head++];
+        solution->expanded++;
+        if(c == g) break;
+
+        unsigned mask = open_dirs(maze, c);
+        for(int d = 0; d < 4; d++) {
+            if(!(mask & (1 << d))) continue;
+            size_t n = neighbour(maze, c, (Direction)d);
+            if(dist[n] != UNSEEN) continue;
+            dist[n] = dist[c] + 1;
+            queue[tail++] = (uint32_t)n;
+        }
+    }
+
+    bool ok = dist[g] == UNSEEN || path_from_dist(maze, dist, g, solution);
+    free(dist);
+    free(queue);
+    if(!ok) free_maze_solution(solution);
+    return ok;
+}
+
+// Min heap of (f << 32 | cell), comparing the whole key breaks ties on the cell index so the
+// order is the same every run
+typedef struct Heap {
+    uint64_t* keys;
+    size_t length;
+    size_t capacity;
+} Heap;
+
+static bool heap_push(Heap* heap, uint64_t key) {
+    if(heap->length == heap->capacity) {
+        size_t capacity = heap->capacity ? heap->capacity * 2 : 1024;
+        uint64_t* keys = realloc(heap->keys, sizeof(uint64_t) * capacity);
+        if(!keys) return false;
+        heap->keys = keys;
+        heap->capacity = capacity;
+    }
+
+    uint64_t* keys = heap->keys;
+    size_t i = heap->length++;
+    while(i > 0) {
+        size_t parent = (i - 1) / 2;
+        if(keys[parent] <= key) break;
+        keys[i] = keys[parent];
+        i = parent;
+    }
+    keys[i] = key;
+    return true;
+}
+
+static uint64_t heap_pop(Heap* heap) {
+    uint64_t* keys = heap->keys;
+    uint64_t top_key = keys[0];
+    uint64_t key = keys[--heap->length];
+    size_t length = heap->length;
+
+    // Sift the last key down from the root
+    size_t i = 0;
+    for(;;) {
+        size_t child = i * 2 + 1;
+        if(child >= length) break;
+        if(child + 1 < length && keys[child + 1] < keys[child]) child++;
+        if(key <= keys[child]) break;
+        keys[i] = keys[child];
+        i = child;
+    }
+    if(length > 0) keys[i] = key;
+    return top_key;
+}
+
+bool solve_maze_astar(maze* maze, int2 start, int2 goal, MazeSolution* solution) {
+    if(!begin_solution(maze, start, goal, solution, "A*")) return false;
+
+    size_t cells = (size_t)maze->width * maze->height;
+    uint32_t* dist = malloc(sizeof(uint32_t) * cells);
+    Heap heap = {NULL, 0, 0};
+    if(!dist) {
+        printf("Not enough memory for the A* solver\n");
+        free_maze_solution(solution);
+        return false;
+    }
+
+    memset(dist, 0xFF, sizeof(uint32_t) * cells);
+    size_t s = maze_index(maze, start);
+    size_t g = maze_index(maze, goal);
+    dist[s] = 0;
+
+    // f is at most cells + width + height, well inside 32 bits with 2^31 cells
+    bool ok = heap_push(&heap, (uint64_t)manhattan(maze, s, goal) << 32 | s);
+    while(ok && heap.length > 0) {
+        uint64_t key = heap_pop(&heap);
+        size_t c = (uint32_t)key;
+        uint32_t f = (uint32_t)(key >> 32);
+
+        // Stale entry, the cell was pushed again with a shorter distance
+        if(f != dist[c] + manhattan(maze, c, goal)) continue;
+        solution->expanded++;
+        if(c == g) break;
+
+        unsigned mask = open_dirs(maze, c);
+        for(int d = 0; d < 4 && ok; d++) {
+            if(!(mask & (1 << d))) continue;
+            size_t n = neighbour(maze, c, (Direction)d);
+            uint32_t nd = dist[c] + 1;
+            if(nd >= dist[n]) continue;
+            dist[n] = nd;
+            ok = heap_push(&heap, (uint64_t)(nd + manhattan(maze, n, goal)) << 32 | n);
+        }
+    }
+    solution->scratch_bytes = sizeof(uint32_t) * cells + sizeof(uint64_t) * heap.capacity;
+
+    if(!ok) {
+        printf("Not enough memory for the A* heap\n");
+    } else if(dist[g] != UNSEEN) {
+        ok = path_from_dist(maze, dist, g, solution);
+    }
+    free(dist);
+    free(heap.keys);
+    if(!ok) free_maze_solution(solution);
+    return ok;
+}
+
+bool solve_maze_bidirectional(maze* maze, int2 start, int2 goal, MazeSolution* solution) {
+    if(!begin_solution(maze, start, goal, solution, "bidirectional")) return false;
+
+    size_t cells = (size_t)maze->width * maze->height;
+    uint32_t* dist[2] = {malloc(sizeof(uint32_t) * cells), malloc(sizeof(uint32_t) * cells)};
+    uint32_t* queue[2] = {malloc(sizeof(uint32_t) * cells), malloc(sizeof(uint32_t) * cells)};
+    if(!dist[0] || !dist[1] || !queue[0] || !queue[1]) {
+        printf("Not enough memory for the bidirectional solver\n");
+        for(int k = 0; k < 2; k++) { free(dist[k]); free(queue[k]); }
+        free_maze_solution(solution);
+        return false;
+    }
+    solution->scratch_bytes = sizeof(uint32_t) * cells * 4;
+
+    memset(dist[0], 0xFF, sizeof(uint32_t) * cells);
+    memset(dist[1], 0xFF, sizeof(uint32_t) * cells);
+
+    // Side 0 grows from the start, side 1 from the goal. [head, tail) is the current level
+    size_t ends[2] = {maze_index(maze, start), maze_index(maze, goal)};
+    size_t head[2] = {0, 0};
+    size_t tail[2] = {1, 1};
+    for(int k = 0; k < 2; k++) {
+        dist[k][ends[k]] = 0;
+        queue[k][0] = (uint32_t)ends[k];
+    }
+
+    // Shortest start -> goal length through meet
+    size_t best = ends[0] == ends[1] ? 0 : SIZE_MAX;
+    size_t meet = ends[0];
+
+    // The first level that meets the other side has the shortest path somewhere in it, so the
+    // level is finished and then it stops
+    while(best == SIZE_MAX && head[0] < tail[0] && head[1] < tail[1]) {
+        int k = tail[0] - head[0] <= tail[1] - head[1] ? 0 : 1;
+        uint32_t* own = dist[k];
+        uint32_t* other = dist[1 - k];
+
+        size_t level_end = tail[k];
+        while(head[k] < level_end) {
+            size_t c = queue[k][head[k]++];
+            solution->expanded++;
+
+            unsigned mask = open_dirs(maze, c);
+            for(int d = 0; d < 4; d++) {
+                if(!(mask & (1 << d))) continue;
+                size_t n = neighbour(maze, c, (Direction)d);
+                if(own[n] != UNSEEN) continue;
+                own[n] = own[c] + 1;
+                queue[k][tail[k]++] = (uint32_t)n;
+
+                if(other[n] != UNSEEN && (size_t)own[n] + other[n] < best) {
+                    best = (size_t)own[n] + other[n];
+                    meet = n;
+                }
+            }
+        }
+    }
+
+    bool ok = true;
+    if(best != SIZE_MAX) {
+        solution->length = best + 1;
+        solution->path = malloc(sizeof(uint32_t) * solution->length);
+        ok = solution->path != NULL;
+    }
+    if(ok && solution->path) {
+        // Start half as usual, the goal half is traced into a copy and flipped onto the end
+        uint32_t* path = solution->path;
+        trace_back(maze, dist[0], meet, path);
+
+        uint32_t* rest = queue[0];
+        trace_back(maze, dist[1], meet, rest);
+        size_t d = dist[0][meet];
+        for(size_t k = 1; k <= dist[1][meet]; k++) {
+            path[d + k] = rest[dist[1][meet] - k];
+        }
+
+        for(size_t k = 0; k < solution->length; k++) {
+            solution->on_path[path[k] >> 6] |= (uint64_t)1 << (path[k] & 63);
+        }
+    } else if(!ok) {
+        printf("Not enough memory for the path\n");
+    }
+
+    for(int k = 0; k < 2; k++) { free(dist[k]); free(queue[k]); }
+    if(!ok) free_maze_solution(solution);
+    return ok;
+}
+
+bool solve_maze_dead_end(maze* maze, int2 start, int2 goal, MazeSolution* solution) {
+    if(!begin_solution(maze, start, goal, solution, "dead-end")) return false;
+
+    size_t cells = (size_t)maze->width * maze->height;
+    uint8_t* degree = malloc(cells);
+    uint32_t* queue = malloc(sizeof(uint32_t) * cells);
+    if(!degree || !queue) {
+        printf("Not enough memory for the dead-end solver\n");
+        free(degree);
+        free(queue);
+        free_maze_solution(solution);
+        return false;
+    }
+    solution->scratch_bytes = cells + sizeof(uint32_t) * cells;
+
+    size_t s = maze_index(maze, start);
+    size_t g = maze_index(maze, goal);
+
+    // Every dead end except the two ends goes in first. A cell is only queued when its degree
+    // drops to 1 (or starts there), which happens once, so the queue never wraps
+    size_t tail = 0;
+    for(size_t i = 0; i < cells; i++) {
+        unsigned mask = open_dirs(maze, i);
+        degree[i] = (mask & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + ((mask >> 3) & 1);
+        if(degree[i] <= 1 && i != s && i != g) queue[tail++] = (uint32_t)i;
+    }
+
+    // on_path is the filled cells until the end, then it gets flipped
+    uint64_t* filled = solution->on_path;
+    size_t head = 0;
+    while(head < tail) {
+        size_t c = queue[head++];
+        filled[c >> 6] |= (uint64_t)1 << (c & 63);
+        solution->expanded++;
+
+        unsigned mask = open_dirs(maze, c);
+        for(int d = 0; d < 4; d++) {
+            if(!(mask & (1 << d))) continue;
+            size_t n = neighbour(maze, c, (Direction)d);
+            if((filled[n >> 6] >> (n & 63)) & 1) continue;
+            if(--degree[n] == 1 && n != s && n != g) queue[tail++] = (uint32_t)n;
+        }
+    }
+
+    size_t words = (cells + 63) / 64;
+    for(size_t w = 0; w < words; w++) {
+        filled[w] = ~filled[w];
+    }
+    if(cells & 63) filled[words - 1] &= ((uint64_t)1 << (cells & 63)) - 1;
+
+    // Start and goal never get filled, so they're left even when nothing joins them, and loops
+    // are never filled either, even the ones off on their own. Walk everything left that the
+    // start reaches, degree is free now and marks the ones seen
+    uint64_t* remaining = filled;
+    head = 0;
+    tail = 0;
+    queue[tail++] = (uint32_t)s;
+    degree[s] = 0xFF;
+    while(head < tail) {
+        size_t c = queue[head++];
+        unsigned mask = open_dirs(maze, c);
+        for(int d = 0; d < 4; d++) {
+            if(!(mask & (1 << d))) continue;
+            size_t n = neighbour(maze, c, (Direction)d);
+            if(!((remaining[n >> 6] >> (n & 63)) & 1) || degree[n] == 0xFF) continue;
+            degree[n] = 0xFF;
+            queue[tail++] = (uint32_t)n;
+        }
+    }
+
+    if(degree[g] != 0xFF) {
+        memset(remaining, 0, words * sizeof(uint64_t));
+    } else {
+        // Only the start's component stays on the path
+        for(size_t w = 0; w < words; w++) {
+            uint64_t bits = remaining[w];
+            while(bits) {
+                size_t c = w * 64 + __builtin_ctzll(bits);
+                bits &= bits - 1;
+                if(degree[c] != 0xFF) remaining[w] &= ~((uint64_t)1 << (c & 63));
+            }
+            solution->length += __builtin_popcountll(remaining[w]);
+        }
+    }
+
+    free(degree);
+    free(queue);
+    return true;
+}
+
+bool solve_maze_with(MazeSolver solver, maze* maze, int2 start, int2 goal, MazeSolution* solution) {
+    switch(solver) {
+        case SOLVER_BFS: return solve_maze_bfs(maze, start, goal, solution);
+        case SOLVER_ASTAR: return solve_maze_astar(maze, start, goal, solution);
+        case SOLVER_BIDIRECTIONAL: return solve_maze_bidirectional(maze, start, goal, solution);
+        case SOLVER_DEAD_END: return solve_maze_dead_end(maze, start, goal, solution);
+        default:
+            printf("Invalid solver: %d\n", solver);
+            return false;
+    }
+}
+
+void free_maze_solution(MazeSolution* solution) {
+    free(solution->path);
+    free(solution->on_path);
+    solution->path = NULL;
+    solution->on_path = NULL;
+    solution->length = 0;
+}
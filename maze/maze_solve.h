@@ -0,0 +1,46 @@
+#pragma once
+#include "maze.h"
+
+// Maze solvers, they only read the walls so they work on any maze, perfect or not
+// Mazes up to 2^31 cells, the scratch arrays are one uint32_t per cell
+
+typedef enum MazeSolver {
+    SOLVER_BFS,
+    SOLVER_ASTAR,
+    SOLVER_BIDIRECTIONAL,
+    SOLVER_DEAD_END,
+    SOLVER_COUNT
+} MazeSolver;
+
+extern const char* solver_names[SOLVER_COUNT];
+
+typedef struct MazeSolution {
+    uint32_t* path;         // Cell indices from start to goal, NULL for dead-end filling
+    size_t length;          // Cells on the path, 0 if the goal can't be reached
+    uint64_t* on_path;      // One bit per cell, what the renderer looks at
+    size_t expanded;        // Cells taken off the queue / heap (filled for dead-end filling)
+    size_t scratch_bytes;   // Peak memory the solver used on top of the solution
+} MazeSolution;
+
+// Shortest path, one distance per cell, flat queue
+bool solve_maze_bfs(maze* maze, int2 start, int2 goal, MazeSolution* solution);
+
+// A* with a binary heap and the Manhattan distance, same path length as the BFS
+bool solve_maze_astar(maze* maze, int2 start, int2 goal, MazeSolution* solution);
+
+// BFS from both ends a level at a time, always growing the smaller frontier
+bool solve_maze_bidirectional(maze* maze, int2 start, int2 goal, MazeSolution* solution);
+
+// Fills every dead end until only the cells between start and goal are left
+// In a perfect maze that's exactly the path, with loops the loops stay too, so only on_path is set
+// If nothing joins start and goal on_path ends up empty and length 0, like the other solvers
+bool solve_maze_dead_end(maze* maze, int2 start, int2 goal, MazeSolution* solution);
+
+// Returns false if the maze is too big or something doesn't fit in memory
+bool solve_maze_with(MazeSolver solver, maze* maze, int2 start, int2 goal, MazeSolution* solution);
+
+void free_maze_solution(MazeSolution* solution);
+
+static inline bool is_on_path(MazeSolution* solution, size_t i) {
+    return (solution->on_path[i >> 6] >> (i & 63)) & 1;
+}
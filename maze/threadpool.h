@@ -0,0 +1,36 @@
+#pragma once
+#include <stdbool.h>
+#include <pthread.h>
+
+// Persistent worker threads, they sleep between jobs instead of being created every frame
+// The thread calling parallelFor works too, so a pool of N has N - 1 extra threads
+
+// Called once per worker with its slice [begin, end) of the job
+typedef void (*ParallelForFn)(void* ctx, int begin, int end, int worker);
+
+typedef struct ThreadPool {
+    pthread_t* threads;
+    int count;                  // Workers, including the calling thread
+
+    pthread_mutex_t mutex;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    unsigned long generation;   // Bumped for every job so the workers know there's a new one
+    int pending;                // Workers still running the current job
+    bool quit;
+
+    ParallelForFn fn;
+    void* ctx;
+    int jobCount;
+} ThreadPool;
+
+int get_cpu_count();
+
+void initThreadPool(ThreadPool* pool, int count);
+
+void freeThreadPool(ThreadPool* pool);
+
+// Splits [0, count) into one contiguous slice per worker and waits for all of them
+// The split only depends on count and the number of workers, so two jobs with the same
+// count give every worker the same slice
+void parallelFor(ThreadPool* pool, int count, ParallelForFn fn, void* ctx);
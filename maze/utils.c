@@ -1,5 +1,11 @@
 #include "utils.h"
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
 void crash(const char* s) {
     fprintf(stderr, s);
 
@@ -83,3 +89,16 @@ bool check_bit(uint8_t byte, uint8_t pos) {
 }
 
 
+
+double get_time_seconds() {
+#ifdef _WIN32
+    LARGE_INTEGER freq, counter;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
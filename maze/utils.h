@@ -16,3 +16,6 @@ void clear_bit(uint8_t* byte, uint8_t pos);
 void toggle_bit(uint8_t* byte, uint8_t pos);
 
 bool check_bit(uint8_t byte, uint8_t pos);
+
+// Seconds from an arbitrary start point, only differences mean something
+double get_time_seconds();
@@ -0,0 +1,16 @@
+#version 330 core
+
+in vec2 vLocal;
+in float vRadius;
+in vec4 vColor;
+out vec4 FragColor;
+
+void main() {
+	// Signed distance to the edge, coverage fades out over about one pixel
+	float d = length(vLocal) - vRadius;
+	float w = max(fwidth(d), 1e-4);
+	float coverage = clamp(0.5 - d / w, 0.0, 1.0);
+	if(coverage <= 0.0) discard;
+
+	FragColor = vec4(vColor.rgb, vColor.a * coverage);
+}
\ No newline at end of file
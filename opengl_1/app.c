@@ -1,4 +1,6 @@
 #include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
 #include <math.h>
 #include <stdio.h>
 #include <string.h>
@@ -13,20 +15,27 @@
 // Ye
 #include "utils.h"
 #include "vector.h"
+#include "rng.h"
 
 // Constants or macros idk
 
-#define MAX_TRIANGLES INT_MAX/2000
+// Triangles per region to start with, the buffer doubles whenever a frame needs more
+#define TRIANGLE_START_CAPACITY 128
 const int MAX_TRAIL_POINTS = INT_MAX/5000;
 
 #define FLOAT2_TO_VEC2(dest, f) glm_vec2_copy((vec2){(f).x, (f).y}, dest) // gipiti
 #define VEC2_TO_FLOAT2(v) ((float2){(v)[0], (v)[1]})
 
 const GLuint WIDTH = 1280; const GLuint HEIGHT = 720;
-const uint16_t CIRC_RES = 32;
 
 GLuint triangleVAO, triangleVBO;
 GLuint shaderProgram;
+GLint projectionLoc;
+mat4 projection;
+
+GLuint circleVAO, circleQuadVBO, circleInstanceVBO;
+GLuint circleShaderProgram;
+GLint circleProjectionLoc;
 
 #define G 667.4f
 
@@ -37,6 +46,14 @@ typedef struct EngineSettings {
     bool enableWorldBoxPhysicsBox;
 } EngineSettings;
 
+// Physics runs at a fixed rate whatever the frame rate is, a frame only decides how many steps to run
+typedef struct FixedTimestep {
+    double dt;              // Length of one step (s)
+    int substeps;           // updateScene calls per step, each one dt / substeps long
+    int maxStepsPerFrame;   // Time past this many steps is dropped, the sim slows down instead of spiralling
+    double accumulator;     // Time not simulated yet, carried to the next frame
+} FixedTimestep;
+
 /* Utils */
 
 typedef vec2 pos2;
@@ -139,13 +156,38 @@ typedef struct Triangle {
     Vertex vertices[3];
 } Triangle;
 
+// Circles are drawn as instances of a single quad, the fragment shader cuts the circle out
+typedef struct CircleInstance {
+    float2 center;
+    float radius;
+    Color col;
+} CircleInstance;
+
+VECTOR_DEFINE(CircleInstance)
+
+// Triangles are written straight into mapped GPU memory. With GL_ARB_buffer_storage the
+// buffer is mapped once and split in TRIANGLE_REGIONS regions, the CPU fills one while the GPU
+// still draws the others. Without it the buffer is orphaned and mapped again every frame
+#define TRIANGLE_REGIONS 3
+
 typedef struct TriangleBuffer {
-    Triangle triangles[MAX_TRIANGLES];
+    Triangle* triangles;    // Region of this frame, only valid between beginTriangles and sendTrianglesToGPU
     int count;
+    int capacity;           // Triangles per region
 } TriangleBuffer;
 
+typedef struct TriangleStream {
+    bool persistent;
+    Triangle* mapped;       // Start of the persistent mapping
+    int region;
+    GLsync fences[TRIANGLE_REGIONS];
+} TriangleStream;
+
 // Global
-TriangleBuffer triangleBuffer = {{}, 0};
+TriangleBuffer triangleBuffer = {NULL, 0, 0};
+TriangleStream triangleStream = {false, NULL, 0, {NULL}};
+Vector_CircleInstance circleBuffer = {NULL, 0, 0};
+Vector_float2 previousPositions;    // Body positions before the last fixed step, for interpolation
 
 // Some CONSTANTS
 const float2 screenCenter = {WIDTH / 2.0f, HEIGHT / 2.0f};
@@ -153,14 +195,43 @@ const Rectangle screenBox = {{0.0f, 0.0f}, {WIDTH, HEIGHT}};
 
 const float2 gravity_acc = {0.0f, 981.0f};
 
-float2 toNDC(float2 screenPos) {
-    return (float2){
-        2.0f * screenPos.x / WIDTH  - 1.0f,
-        1.0f - 2.0f * screenPos.y / HEIGHT
-    };
+// Pixels (origin at the top left, y down) to clip space, done by the vertex shader
+// Panning or zooming only changes this matrix, the geometry stays in pixels
+void updateProjection(float2 pan, float zoom) {
+    glm_ortho(pan.x, pan.x + WIDTH / zoom, pan.y + HEIGHT / zoom, pan.y, -1.0f, 1.0f, projection);
 }
 
 /* Initialization(s) */
+
+// Storage for the buffer bound to GL_ARRAY_BUFFER, capacity triangles per region
+void allocateTriangleStorage(int capacity) {
+    triangleBuffer.capacity = capacity;
+
+    if(triangleStream.persistent) {
+        GLsizeiptr size = (GLsizeiptr)sizeof(Triangle) * capacity * TRIANGLE_REGIONS;
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+        glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+        triangleStream.mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+        if(!triangleStream.mapped) {
+            crash("Failed to map the triangle buffer");
+        }
+    } else {
+        glBufferData(GL_ARRAY_BUFFER, sizeof(Triangle) * capacity, NULL, GL_STREAM_DRAW);
+    }
+}
+
+// The VAO keeps the buffer it was set up with, so this runs again when the buffer is replaced
+void setTriangleAttributes() {
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE,
+                          sizeof(Vertex), (void*)(offsetof(Vertex, pos)));
+    glEnableVertexAttribArray(0);
+
+    glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+                          sizeof(Vertex), (void*)(offsetof(Vertex, col)));
+    glEnableVertexAttribArray(1);
+}
+
 void initTriangleRenderer(GLuint* triangleVAO, GLuint* triangleVBO) {
     glGenVertexArrays(1, triangleVAO);
     glGenBuffers(1, triangleVBO);
@@ -168,15 +239,49 @@ void initTriangleRenderer(GLuint* triangleVAO, GLuint* triangleVBO) {
     glBindVertexArray(*triangleVAO);
     glBindBuffer(GL_ARRAY_BUFFER, *triangleVBO);
 
-    glBufferData(GL_ARRAY_BUFFER, sizeof(Triangle) * MAX_TRIANGLES, NULL, GL_DYNAMIC_DRAW);
+    triangleStream.persistent = GLEW_ARB_buffer_storage;
+    allocateTriangleStorage(TRIANGLE_START_CAPACITY);
+    setTriangleAttributes();
 
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE,
-                          sizeof(Vertex), (void*)(offsetof(Vertex, pos)));
+    glBindVertexArray(0);
+}
+
+void initCircleRenderer(GLuint* circleVAO, GLuint* quadVBO, GLuint* instanceVBO) {
+    const float corners[] = {
+        -1.0f, -1.0f,
+         1.0f, -1.0f,
+        -1.0f,  1.0f,
+         1.0f,  1.0f
+    };
+
+    glGenVertexArrays(1, circleVAO);
+    glGenBuffers(1, quadVBO);
+    glGenBuffers(1, instanceVBO);
+
+    glBindVertexArray(*circleVAO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, *quadVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
 
-    glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE,
-                          sizeof(Vertex), (void*)(offsetof(Vertex, col)));
+    // The instance buffer gets its size on the first upload
+    glBindBuffer(GL_ARRAY_BUFFER, *instanceVBO);
+
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE,
+                          sizeof(CircleInstance), (void*)(offsetof(CircleInstance, center)));
     glEnableVertexAttribArray(1);
+    glVertexAttribDivisor(1, 1);
+
+    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE,
+                          sizeof(CircleInstance), (void*)(offsetof(CircleInstance, radius)));
+    glEnableVertexAttribArray(2);
+    glVertexAttribDivisor(2, 1);
+
+    glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+                          sizeof(CircleInstance), (void*)(offsetof(CircleInstance, col)));
+    glEnableVertexAttribArray(3);
+    glVertexAttribDivisor(3, 1);
 
     glBindVertexArray(0);
 }
@@ -225,29 +330,126 @@ GLuint createShaderProgram(const char* vertSrc, const char* fragSrc) {
 }
 
 /* Used*/
+
+// Starts the triangles of a frame, call it before any draw
+void beginTriangles() {
+    triangleBuffer.count = 0;
+
+    if(triangleStream.persistent) {
+        int region = triangleStream.region;
+
+        // Only blocks if the GPU is still reading this region from TRIANGLE_REGIONS frames ago
+        GLsync fence = triangleStream.fences[region];
+        if(fence) {
+            while(glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {}
+            glDeleteSync(fence);
+            triangleStream.fences[region] = NULL;
+        }
+
+        triangleBuffer.triangles = triangleStream.mapped + (size_t)region * triangleBuffer.capacity;
+    } else {
+        GLsizeiptr size = sizeof(Triangle) * triangleBuffer.capacity;
+
+        // Orphaning, the driver hands out fresh memory and keeps the old one alive for the draw in flight
+        glBindBuffer(GL_ARRAY_BUFFER, triangleVBO);
+        glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+        triangleBuffer.triangles = glMapBufferRange(GL_ARRAY_BUFFER, 0, size,
+                                                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    }
+}
+
 void sendTrianglesToGPU() {
     glUseProgram(shaderProgram);
+    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, (float*)projection);
     glBindVertexArray(triangleVAO);
     glBindBuffer(GL_ARRAY_BUFFER, triangleVBO);
 
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Triangle) * triangleBuffer.count, triangleBuffer.triangles);
-    glDrawArrays(GL_TRIANGLES, 0, triangleBuffer.count * 3);
+    if(triangleStream.persistent) {
+        int first = triangleStream.region * triangleBuffer.capacity * 3;
+        glDrawArrays(GL_TRIANGLES, first, triangleBuffer.count * 3);
+
+        triangleStream.fences[triangleStream.region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        triangleStream.region = (triangleStream.region + 1) % TRIANGLE_REGIONS;
+    } else {
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glDrawArrays(GL_TRIANGLES, 0, triangleBuffer.count * 3);
+    }
+    triangleBuffer.triangles = NULL;
 
     glBindVertexArray(0);
 
 }
 
-// Prob gonna change it to GPU side rendering, like \/ gonna disappear (probably)
-void drawTriangle(Triangle* triangle) {
-    if (triangleBuffer.count >= MAX_TRIANGLES) return;
+void sendCirclesToGPU() {
+    if(circleBuffer.length == 0) return;
+
+    glUseProgram(circleShaderProgram);
+    glUniformMatrix4fv(circleProjectionLoc, 1, GL_FALSE, (float*)projection);
+
+    glBindVertexArray(circleVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, circleInstanceVBO);
 
-    Triangle ndcTriangle = *triangle;
-    for(int i = 0; i < 3; i++) {
-        ndcTriangle.vertices[i].pos = toNDC(triangle->vertices[i].pos);
+    // Reallocating every frame lets the driver hand out fresh memory instead of waiting on the last draw
+    glBufferData(GL_ARRAY_BUFFER, sizeof(CircleInstance) * circleBuffer.length, circleBuffer.data, GL_STREAM_DRAW);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, circleBuffer.length);
+
+    glBindVertexArray(0);
+}
+
+// Called when a frame runs out of room. The triangles already written are copied on the GPU
+// to a new buffer twice as big and the frame carries on there, nothing gets dropped
+void growTriangleBuffer() {
+    GLintptr usedOffset = 0;
+    if(triangleStream.persistent) {
+        usedOffset = (GLintptr)sizeof(Triangle) * triangleStream.region * triangleBuffer.capacity;
+    }
+    GLsizeiptr used = (GLsizeiptr)sizeof(Triangle) * triangleBuffer.count;
+
+    glBindBuffer(GL_COPY_READ_BUFFER, triangleVBO);
+    // A persistent mapping can stay while the GPU copies from it, a normal one can't
+    if(!triangleStream.persistent) {
+        glUnmapBuffer(GL_COPY_READ_BUFFER);
+    }
+
+    GLuint newVBO;
+    glGenBuffers(1, &newVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, newVBO);
+    allocateTriangleStorage(triangleBuffer.capacity * 2);
+
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_ARRAY_BUFFER, usedOffset, 0, used);
+
+    // The GPU keeps the old buffer alive until the draws still using it are done
+    glDeleteBuffers(1, &triangleVBO);
+    triangleVBO = newVBO;
+
+    for(int i = 0; i < TRIANGLE_REGIONS; i++) {
+        if(triangleStream.fences[i]) {
+            glDeleteSync(triangleStream.fences[i]);
+            triangleStream.fences[i] = NULL;
+        }
+    }
+    triangleStream.region = 0;
+
+    if(triangleStream.persistent) {
+        triangleBuffer.triangles = triangleStream.mapped;
+    } else {
+        // No invalidate bit, the copied triangles have to stay. This map waits for the copy
+        triangleBuffer.triangles = glMapBufferRange(GL_ARRAY_BUFFER, 0, sizeof(Triangle) * triangleBuffer.capacity,
+                                                    GL_MAP_WRITE_BIT);
     }
 
-    if (triangleBuffer.count >= MAX_TRIANGLES) return; // safety
-    triangleBuffer.triangles[triangleBuffer.count++] = ndcTriangle;
+    glBindVertexArray(triangleVAO);
+    setTriangleAttributes();
+    glBindVertexArray(0);
+}
+
+// Prob gonna change it to GPU side rendering, like \/ gonna disappear (probably)
+void drawTriangle(Triangle* triangle) {
+    if (!triangleBuffer.triangles) return;
+    if (triangleBuffer.count >= triangleBuffer.capacity) growTriangleBuffer();
+
+    // Write only, the mapped memory is usually write combined and slow to read back
+    triangleBuffer.triangles[triangleBuffer.count++] = *triangle;
 }
 
 void drawRectangle(Rectangle rect) {
@@ -304,28 +506,7 @@ void drawLine(Line line) {
 }
 
 void drawCircle(float r, float2 pos, Color col) {
-    float theta = (2 * M_PI) / CIRC_RES;
-
-    for(int i = 0; i < CIRC_RES; i++) {
-        float theta_i = theta*i;
-        float theta_i_2 = theta * (i+1);
-
-        float2 pos_theta_i = {r * cos(theta_i), r * sin(theta_i)};
-        float2 pos_theta_i2 = {r * cos(theta_i_2), r * sin(theta_i_2)};
-
-        float2 final_pos_i = {pos.x + pos_theta_i.x, pos.y + pos_theta_i.y};
-        float2 final_pos_i2 = {pos.x + pos_theta_i2.x, pos.y + pos_theta_i2.y};
-
-        Triangle fragCircle = {
-            {
-                {pos, col},
-                {final_pos_i, col},
-                {final_pos_i2, col}
-            }
-        };
-
-        drawTriangle(&fragCircle);
-    }
+    append_vector_CircleInstance(&circleBuffer, (CircleInstance){pos, r, col});
 }
 
 void updateTrail(Trail* trail, float2 pos) {
@@ -540,19 +721,56 @@ void updateScene(double deltaTime, Vector_PhysicBody* bodies, EngineSettings* en
 // Probably gonna change to a easier way to make trails for bodies
 // Trail bodyTrail;
 
-void renderScene(GLFWwindow* window, Vector_PhysicBody* bodies) {
+void saveBodyPositions(Vector_float2* positions, Vector_PhysicBody* bodies) {
+    positions->length = 0;
+    for(int i = 0; i < bodies->length; i++) {
+        append_vector_float2(positions, bodies->data[i].circ.pos);
+    }
+}
+
+// Runs the fixed steps that fit in the accumulated time, returns how many ran
+// The positions are only saved before the last one, that's the only one rendering needs
+int advanceFixedTimestep(FixedTimestep* timestep, double frameTime, Vector_PhysicBody* bodies, EngineSettings* engineSettings) {
+    timestep->accumulator += frameTime;
+
+    int steps = (int)(timestep->accumulator / timestep->dt);
+    if(steps > timestep->maxStepsPerFrame) {
+        steps = timestep->maxStepsPerFrame;
+        timestep->accumulator = fmod(timestep->accumulator, timestep->dt) + steps * timestep->dt;
+    }
+
+    double substepDt = timestep->dt / timestep->substeps;
+    for(int s = 0; s < steps; s++) {
+        if(s == steps - 1) {
+            saveBodyPositions(&previousPositions, bodies);
+        }
+        for(int i = 0; i < timestep->substeps; i++) {
+            updateScene(substepDt, bodies, engineSettings);
+        }
+        timestep->accumulator -= timestep->dt;
+    }
+
+    return steps;
+}
+
+// alpha 0 draws the bodies where they were before the last step, 1 where they are now
+void renderScene(GLFWwindow* window, Vector_PhysicBody* bodies, float alpha) {
     //glClearColor(0.05f, 0.05f, 0.1f, 1.0f);
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
 
-    triangleBuffer.count = 0;
+    beginTriangles();
+    circleBuffer.length = 0;
 
     // To update and render the trail, prob gonna change it too
     // updateTrail(&bodyTrail, bodies->data[0].circ.pos);
     // drawTrail(&bodyTrail, 2.0f);
 
     for(int i = 0 ; i < bodies->length; i++) {
-        drawCircle(bodies->data[i].circ.r, bodies->data[i].circ.pos, bodies->data[i].circ.col);
+        float2 cur = bodies->data[i].circ.pos;
+        float2 prev = i < previousPositions.length ? previousPositions.data[i] : cur;
+        float2 pos = float2_add(prev, float2_mul(float2_sub(cur, prev), alpha));
+        drawCircle(bodies->data[i].circ.r, pos, bodies->data[i].circ.col);
     }
 
     // Test
@@ -560,27 +778,31 @@ void renderScene(GLFWwindow* window, Vector_PhysicBody* bodies) {
     // drawRectangle(a);
 
     sendTrianglesToGPU();
+    sendCirclesToGPU();
 
     glfwSwapBuffers(window);
 }
 
-void gameLoop(GLFWwindow* window, Vector_PhysicBody* bodies, EngineSettings* engineSettings) {
+void gameLoop(GLFWwindow* window, Vector_PhysicBody* bodies, EngineSettings* engineSettings, FixedTimestep* timestep) {
     double lastTime = glfwGetTime();
 
+    saveBodyPositions(&previousPositions, bodies);
+
     while (!glfwWindowShouldClose(window)) {
         double currentTime = glfwGetTime();
-        float deltaTime = (float)(currentTime - lastTime);
+        double frameTime = currentTime - lastTime;
         lastTime = currentTime;
 
         glfwPollEvents();
 
-        updateScene(deltaTime, bodies, engineSettings);
-        renderScene(window, bodies);
+        advanceFixedTimestep(timestep, frameTime, bodies, engineSettings);
+        renderScene(window, bodies, (float)(timestep->accumulator / timestep->dt));
     }
 }
 
 void generateBodies(Vector_PhysicBody* bodies, int count) {
-    float mass = (float)(rand() % 500 + 100);
+    Rng* rng = rng_local();
+    float mass = (float)rng_range(rng, 100, 599);
     float radius = sqrtf(mass) * 0.5f;
 
     Vector_float2 positions;
@@ -588,8 +810,8 @@ void generateBodies(Vector_PhysicBody* bodies, int count) {
 
     for(int i = 0; i < count; i++) {
         float2 pos = {
-            (float)(rand() % WIDTH),
-            (float)(rand() % HEIGHT)
+            (float)rng_below(rng, WIDTH),
+            (float)rng_below(rng, HEIGHT)
         };
 
         if(positions.length > 0) {
@@ -605,8 +827,8 @@ void generateBodies(Vector_PhysicBody* bodies, int count) {
                     if(distSqr < minDist * minDist) {
                         overlapping = true;
                         pos = (float2){
-                            (float)(rand() % WIDTH),
-                            (float)(rand() % HEIGHT)
+                            (float)rng_below(rng, WIDTH),
+                            (float)rng_below(rng, HEIGHT)
                         };
                         break;
                     }
@@ -623,9 +845,9 @@ void generateBodies(Vector_PhysicBody* bodies, int count) {
         if(pos.y < radius) pos.y = radius;
 
         Color col = {
-            (uint8_t)(rand() % 256),
-            (uint8_t)(rand() % 256),
-            (uint8_t)(rand() % 256),
+            (uint8_t)rng_below(rng, 256),
+            (uint8_t)rng_below(rng, 256),
+            (uint8_t)rng_below(rng, 256),
             255
         };
 
@@ -648,6 +870,33 @@ int main(int argc, const char * argv[]) {
         true
     };
 
+    FixedTimestep timestep = {
+        1.0 / 120.0,    // dt
+        1,              // substeps
+        8,              // max steps per frame
+        0.0
+    };
+
+    uint64_t seed = rng_time_seed();
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--tick-rate") == 0 && i + 1 < argc) {
+            double hz = atof(argv[++i]);
+            if(hz > 0) timestep.dt = 1.0 / hz;
+        } else if(strcmp(argv[i], "--substeps") == 0 && i + 1 < argc) {
+            timestep.substeps = atoi(argv[++i]);
+            if(timestep.substeps < 1) timestep.substeps = 1;
+        } else if(strcmp(argv[i], "--max-steps") == 0 && i + 1 < argc) {
+            timestep.maxStepsPerFrame = atoi(argv[++i]);
+            if(timestep.maxStepsPerFrame < 1) timestep.maxStepsPerFrame = 1;
+        }
+    }
+
+    rng_set_seed(seed);
+    printf("Seed: %llu\n", (unsigned long long)seed);
+
     GLFWwindow* window = initialize();
     initTriangleRenderer(&triangleVAO, &triangleVBO);
 
@@ -655,10 +904,23 @@ int main(int argc, const char * argv[]) {
 	const char* fragSrc = load_file_as_string("Shaders/triangle_shader.frag");
 
 	shaderProgram = createShaderProgram(vertSrc, fragSrc);
+	projectionLoc = glGetUniformLocation(shaderProgram, "uProjection");
+	updateProjection((float2){0.0f, 0.0f}, 1.0f);
 
     free((void*)vertSrc);
     free((void*)fragSrc);
 
+    initCircleRenderer(&circleVAO, &circleQuadVBO, &circleInstanceVBO);
+
+    const char* circleVertSrc = load_file_as_string("Shaders/circle_shader.vert");
+    const char* circleFragSrc = load_file_as_string("Shaders/circle_shader.frag");
+
+    circleShaderProgram = createShaderProgram(circleVertSrc, circleFragSrc);
+    circleProjectionLoc = glGetUniformLocation(circleShaderProgram, "uProjection");
+
+    free((void*)circleVertSrc);
+    free((void*)circleFragSrc);
+
     // Example to make a body
     /*
     float mass = 900.0f;
@@ -690,10 +952,14 @@ int main(int argc, const char * argv[]) {
     // Do not try more than like
     generateBodies(&Sim_Bodies, 1000);
 
-    gameLoop(window, &Sim_Bodies, &engineSettings);
+    init_vector_float2(&previousPositions);
+
+    gameLoop(window, &Sim_Bodies, &engineSettings, &timestep);
     glfwTerminate();
 
     free_vector_PhysicBody(&Sim_Bodies);
+    free_vector_float2(&previousPositions);
+    free_vector_CircleInstance(&circleBuffer);
 
     return EXIT_SUCCESS;
 }
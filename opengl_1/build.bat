@@ -1,5 +1,5 @@
 cls
 
-gcc app.c utils.c -o OpenGL_1.exe -lglfw3 -lglew32 -lopengl32 -lgdi32 -luser32 -lkernel32
+gcc app.c utils.c rng.c -o OpenGL_1.exe -lglfw3 -lglew32 -lopengl32 -lgdi32 -luser32 -lkernel32
 .\OpenGL_1.exe
 
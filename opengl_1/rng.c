@@ -0,0 +1,56 @@
+#include "rng.h"
+#include <time.h>
+
+static uint64_t global_seed = 0x853C49E6748FEA9BULL;
+static uint64_t next_stream = 0;
+
+static _Thread_local Rng local_rng;
+static _Thread_local int local_seeded = 0;
+
+void rng_seed(Rng* rng, uint64_t seed, uint64_t stream) {
+    rng->state = 0;
+    rng->inc = (stream << 1u) | 1u;
+    rng_next(rng);
+    rng->state += seed;
+    rng_next(rng);
+}
+
+void rng_set_seed(uint64_t seed) {
+    global_seed = seed;
+    rng_seed(&local_rng, seed, 0);
+    local_seeded = 1;
+    __atomic_store_n(&next_stream, 1, __ATOMIC_RELAXED);
+}
+
+uint64_t rng_get_seed() {
+    return global_seed;
+}
+
+uint64_t rng_time_seed() {
+    uint64_t seed = (uint64_t)time(NULL);
+    uint64_t ticks = (uint64_t)clock();
+    // splitmix64 so close times give very different seeds
+    uint64_t z = seed * 0x9E3779B97F4A7C15ULL + ticks;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+Rng* rng_local() {
+    if(!local_seeded) {
+        uint64_t stream = __atomic_fetch_add(&next_stream, 1, __ATOMIC_RELAXED);
+        rng_seed(&local_rng, global_seed, stream);
+        local_seeded = 1;
+    }
+    return &local_rng;
+}
+
+void rng_floats(Rng* rng, float* out, size_t count, float min, float max) {
+    // Local copy of the state so the loop keeps it in registers
+    Rng r = *rng;
+    float scale = (max - min) * (1.0f / 16777216.0f);
+    for(size_t i = 0; i < count; i++) {
+        out[i] = min + (rng_next(&r) >> 8) * scale;
+    }
+    *rng = r;
+}
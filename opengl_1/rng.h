@@ -0,0 +1,65 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// PCG32 random numbers, replaces rand()/srand
+// Every thread gets its own state (rng_local) so nothing is shared or locked, and every state
+// comes from one seed so a run can be repeated with --seed
+
+typedef struct Rng {
+    uint64_t state;
+    uint64_t inc;       // Picks the stream, always odd
+} Rng;
+
+// Seeds rng with stream number stream of seed, different streams never overlap
+void rng_seed(Rng* rng, uint64_t seed, uint64_t stream);
+
+// Seed the thread states come from, call it once at startup before using rng_local
+void rng_set_seed(uint64_t seed);
+
+uint64_t rng_get_seed();
+
+// A seed from the clock for when there's no --seed
+uint64_t rng_time_seed();
+
+// State of the calling thread, seeded on the first call with the next free stream
+// The thread that calls rng_set_seed gets stream 0
+Rng* rng_local();
+
+static inline uint32_t rng_next(Rng* rng) {
+    uint64_t old = rng->state;
+    rng->state = old * 6364136223846793005ULL + rng->inc;
+    uint32_t xorshifted = (uint32_t)(((old >> 18u) ^ old) >> 27u);
+    uint32_t rot = (uint32_t)(old >> 59u);
+    return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
+// [0, bound) without bias, Lemire's multiply and shift. Only retries (rarely) when the low
+// half lands in the few values that would make some results more likely
+static inline uint32_t rng_below(Rng* rng, uint32_t bound) {
+    uint64_t m = (uint64_t)rng_next(rng) * bound;
+    uint32_t low = (uint32_t)m;
+    if(low < bound) {
+        uint32_t threshold = -bound % bound;
+        while(low < threshold) {
+            m = (uint64_t)rng_next(rng) * bound;
+            low = (uint32_t)m;
+        }
+    }
+    return (uint32_t)(m >> 32);
+}
+
+// [min, max] inclusive
+static inline int rng_range(Rng* rng, int min, int max) {
+    uint32_t span = (uint32_t)max - (uint32_t)min + 1;
+    if(span == 0) return (int)rng_next(rng);
+    return (int)((uint32_t)min + rng_below(rng, span));
+}
+
+// [0, 1), 24 random bits so every value is exactly representable
+static inline float rng_float(Rng* rng) {
+    return (rng_next(rng) >> 8) * (1.0f / 16777216.0f);
+}
+
+// count floats in [min, max)
+void rng_floats(Rng* rng, float* out, size_t count, float min, float max);
@@ -1,10 +1,12 @@
 #version 330 core
-layout (location = 0) in vec2 aPos;
+layout (location = 0) in vec2 aPos;	// Pixels
 layout (location = 1) in vec4 aColor;
 
+uniform mat4 uProjection;
+
 out vec4 vColor;
 
 void main() {
-	gl_Position = vec4(aPos.x, aPos.y, 0.0, 1.0);
+	gl_Position = uProjection * vec4(aPos, 0.0, 1.0);
 	vColor = aColor;
 }
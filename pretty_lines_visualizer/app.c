@@ -16,8 +16,10 @@
 // Ye
 #include "utils.h"
 #include "vector.h"
+#include "rng.h"
 
-#define MAX_TRIANGLES INT_MAX/2000
+// Triangles per region to start with, the buffer doubles whenever a frame needs more
+#define TRIANGLE_START_CAPACITY 128
 
 #define FLOAT2_TO_VEC2(dest, f) glm_vec2_copy((vec2){(f).x, (f).y}, dest) // gipiti
 #define VEC2_TO_FLOAT2(v) ((float2){(v)[0], (v)[1]})
@@ -32,7 +34,10 @@ const GLuint WIDTH = MAZE_WITDH * GRID_SIZE + 10.0f; const GLuint HEIGHT = MAZE_
 const uint16_t CIRC_RES = 32;
 
 GLuint triangleVAO, triangleVBO;
+GLuint quadVAO, quadVBO, quadEBO;
 GLuint shaderProgram;
+GLint projectionLoc;
+mat4 projection;
 
 
 typedef vec2 pos2;
@@ -99,36 +104,71 @@ typedef struct Triangle {
     Vertex vertices[3];
 } Triangle;
 
+// Triangles are written straight into mapped GPU memory. With GL_ARB_buffer_storage the
+// buffer is mapped once and split in TRIANGLE_REGIONS regions, the CPU fills one while the GPU
+// still draws the others. Without it the buffer is orphaned and mapped again every frame
+#define TRIANGLE_REGIONS 3
+
 typedef struct TriangleBuffer {
-    Triangle triangles[MAX_TRIANGLES];
+    Triangle* triangles;    // Region of this frame, only valid between beginTriangles and sendTrianglesToGPU
     int count;
+    int capacity;           // Triangles per region
 } TriangleBuffer;
 
+// Rectangles go in their own batch, 4 vertices each drawn through a shared index buffer
+// (0 1 2, 0 2 3 for every quad) instead of 6 vertices as 2 triangles
+typedef struct Quad {
+    Vertex vertices[4];
+} Quad;
+
+VECTOR_DEFINE(Quad)
+
+typedef struct TriangleStream {
+    bool persistent;
+    Triangle* mapped;       // Start of the persistent mapping
+    int region;
+    GLsync fences[TRIANGLE_REGIONS];
+} TriangleStream;
+
 // Global
-TriangleBuffer triangleBuffer = {{}, 0};
+TriangleBuffer triangleBuffer = {NULL, 0, 0};
+TriangleStream triangleStream = {false, NULL, 0, {NULL}};
+Vector_Quad quadBuffer = {NULL, 0, 0};
+int quadIndexCapacity = 0;      // Quads the index buffer covers
 
 // Some CONSTANTS
 const float2 screenCenter = {WIDTH / 2.0f, HEIGHT / 2.0f};
 const Rectangle screenBox = {{0.0f, 0.0f}, {WIDTH, HEIGHT}};
 
 
-float2 toNDC(float2 screenPos) {
-    return (float2){
-        2.0f * screenPos.x / WIDTH  - 1.0f,
-        1.0f - 2.0f * screenPos.y / HEIGHT
-    };
+// Pixels (origin at the top left, y down) to clip space, done by the vertex shader
+// Panning or zooming only changes this matrix, the geometry stays in pixels
+void updateProjection(float2 pan, float zoom) {
+    glm_ortho(pan.x, pan.x + WIDTH / zoom, pan.y + HEIGHT / zoom, pan.y, -1.0f, 1.0f, projection);
 }
 
 /* Initialization(s) */
-void initTriangleRenderer(GLuint* triangleVAO, GLuint* triangleVBO) {
-    glGenVertexArrays(1, triangleVAO);
-    glGenBuffers(1, triangleVBO);
 
-    glBindVertexArray(*triangleVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, *triangleVBO);
+// Storage for the buffer bound to GL_ARRAY_BUFFER, capacity triangles per region
+void allocateTriangleStorage(int capacity) {
+    triangleBuffer.capacity = capacity;
+
+    if(triangleStream.persistent) {
+        GLsizeiptr size = (GLsizeiptr)sizeof(Triangle) * capacity * TRIANGLE_REGIONS;
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
 
-    glBufferData(GL_ARRAY_BUFFER, sizeof(Triangle) * MAX_TRIANGLES, NULL, GL_DYNAMIC_DRAW);
+        glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+        triangleStream.mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+        if(!triangleStream.mapped) {
+            crash("Failed to map the triangle buffer");
+        }
+    } else {
+        glBufferData(GL_ARRAY_BUFFER, sizeof(Triangle) * capacity, NULL, GL_STREAM_DRAW);
+    }
+}
 
+// The VAO keeps the buffer it was set up with, so this runs again when the buffer is replaced
+void setTriangleAttributes() {
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE,
                           sizeof(Vertex), (void*)(offsetof(Vertex, pos)));
     glEnableVertexAttribArray(0);
@@ -136,6 +176,33 @@ void initTriangleRenderer(GLuint* triangleVAO, GLuint* triangleVBO) {
     glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE,
                           sizeof(Vertex), (void*)(offsetof(Vertex, col)));
     glEnableVertexAttribArray(1);
+}
+
+void initTriangleRenderer(GLuint* triangleVAO, GLuint* triangleVBO) {
+    glGenVertexArrays(1, triangleVAO);
+    glGenBuffers(1, triangleVBO);
+
+    glBindVertexArray(*triangleVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, *triangleVBO);
+
+    triangleStream.persistent = GLEW_ARB_buffer_storage;
+    allocateTriangleStorage(TRIANGLE_START_CAPACITY);
+    setTriangleAttributes();
+
+    glBindVertexArray(0);
+}
+
+void initQuadRenderer(GLuint* quadVAO, GLuint* quadVBO, GLuint* quadEBO) {
+    glGenVertexArrays(1, quadVAO);
+    glGenBuffers(1, quadVBO);
+    glGenBuffers(1, quadEBO);
+
+    glBindVertexArray(*quadVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, *quadVBO);
+    setTriangleAttributes();
+
+    // The VAO remembers the index buffer
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, *quadEBO);
 
     glBindVertexArray(0);
 }
@@ -184,29 +251,152 @@ GLuint createShaderProgram(const char* vertSrc, const char* fragSrc) {
 }
 
 /* Used*/
+
+// Starts the triangles of a frame, call it before any draw
+void beginTriangles() {
+    triangleBuffer.count = 0;
+
+    if(triangleStream.persistent) {
+        int region = triangleStream.region;
+
+        // Only blocks if the GPU is still reading this region from TRIANGLE_REGIONS frames ago
+        GLsync fence = triangleStream.fences[region];
+        if(fence) {
+            while(glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {}
+            glDeleteSync(fence);
+            triangleStream.fences[region] = NULL;
+        }
+
+        triangleBuffer.triangles = triangleStream.mapped + (size_t)region * triangleBuffer.capacity;
+    } else {
+        GLsizeiptr size = sizeof(Triangle) * triangleBuffer.capacity;
+
+        // Orphaning, the driver hands out fresh memory and keeps the old one alive for the draw in flight
+        glBindBuffer(GL_ARRAY_BUFFER, triangleVBO);
+        glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+        triangleBuffer.triangles = glMapBufferRange(GL_ARRAY_BUFFER, 0, size,
+                                                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    }
+}
+
 void sendTrianglesToGPU() {
     glUseProgram(shaderProgram);
+    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, (float*)projection);
     glBindVertexArray(triangleVAO);
     glBindBuffer(GL_ARRAY_BUFFER, triangleVBO);
 
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Triangle) * triangleBuffer.count, triangleBuffer.triangles);
-    glDrawArrays(GL_TRIANGLES, 0, triangleBuffer.count * 3);
+    if(triangleStream.persistent) {
+        int first = triangleStream.region * triangleBuffer.capacity * 3;
+        glDrawArrays(GL_TRIANGLES, first, triangleBuffer.count * 3);
+
+        triangleStream.fences[triangleStream.region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        triangleStream.region = (triangleStream.region + 1) % TRIANGLE_REGIONS;
+    } else {
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glDrawArrays(GL_TRIANGLES, 0, triangleBuffer.count * 3);
+    }
+    triangleBuffer.triangles = NULL;
 
     glBindVertexArray(0);
 
 }
 
-// Prob gonna change it to GPU side rendering, like \/ gonna disappear (probably)
-void drawTriangle(Triangle* triangle) {
-    if (triangleBuffer.count >= MAX_TRIANGLES) return;
+// Called when a frame runs out of room. The triangles already written are copied on the GPU
+// to a new buffer twice as big and the frame carries on there, nothing gets dropped
+void growTriangleBuffer() {
+    GLintptr usedOffset = 0;
+    if(triangleStream.persistent) {
+        usedOffset = (GLintptr)sizeof(Triangle) * triangleStream.region * triangleBuffer.capacity;
+    }
+    GLsizeiptr used = (GLsizeiptr)sizeof(Triangle) * triangleBuffer.count;
+
+    glBindBuffer(GL_COPY_READ_BUFFER, triangleVBO);
+    // A persistent mapping can stay while the GPU copies from it, a normal one can't
+    if(!triangleStream.persistent) {
+        glUnmapBuffer(GL_COPY_READ_BUFFER);
+    }
+
+    GLuint newVBO;
+    glGenBuffers(1, &newVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, newVBO);
+    allocateTriangleStorage(triangleBuffer.capacity * 2);
+
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_ARRAY_BUFFER, usedOffset, 0, used);
+
+    // The GPU keeps the old buffer alive until the draws still using it are done
+    glDeleteBuffers(1, &triangleVBO);
+    triangleVBO = newVBO;
+
+    for(int i = 0; i < TRIANGLE_REGIONS; i++) {
+        if(triangleStream.fences[i]) {
+            glDeleteSync(triangleStream.fences[i]);
+            triangleStream.fences[i] = NULL;
+        }
+    }
+    triangleStream.region = 0;
+
+    if(triangleStream.persistent) {
+        triangleBuffer.triangles = triangleStream.mapped;
+    } else {
+        // No invalidate bit, the copied triangles have to stay. This map waits for the copy
+        triangleBuffer.triangles = glMapBufferRange(GL_ARRAY_BUFFER, 0, sizeof(Triangle) * triangleBuffer.capacity,
+                                                    GL_MAP_WRITE_BIT);
+    }
+
+    glBindVertexArray(triangleVAO);
+    setTriangleAttributes();
+    glBindVertexArray(0);
+}
+
+// The indices never change, they're only rebuilt (twice as many) when a frame has more quads than before
+void reserveQuadIndices(int quads) {
+    if(quads <= quadIndexCapacity) return;
+
+    int capacity = quadIndexCapacity ? quadIndexCapacity : 256;
+    while(capacity < quads) capacity *= 2;
 
-    Triangle ndcTriangle = *triangle;
-    for(int i = 0; i < 3; i++) {
-        ndcTriangle.vertices[i].pos = toNDC(triangle->vertices[i].pos);
+    GLuint* indices = malloc(sizeof(GLuint) * 6 * capacity);
+    assert(indices && "malloc failed");
+    for(int q = 0; q < capacity; q++) {
+        GLuint base = q * 4;
+        GLuint* i = &indices[q * 6];
+        i[0] = base; i[1] = base + 1; i[2] = base + 2;
+        i[3] = base; i[4] = base + 2; i[5] = base + 3;
     }
 
-    if (triangleBuffer.count >= MAX_TRIANGLES) return; // safety
-    triangleBuffer.triangles[triangleBuffer.count++] = ndcTriangle;
+    glBindVertexArray(quadVAO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * 6 * capacity, indices, GL_STATIC_DRAW);
+    glBindVertexArray(0);
+
+    free(indices);
+    quadIndexCapacity = capacity;
+}
+
+void sendQuadsToGPU() {
+    if(quadBuffer.length == 0) return;
+
+    reserveQuadIndices(quadBuffer.length);
+
+    glUseProgram(shaderProgram);
+    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, (float*)projection);
+    glBindVertexArray(quadVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+
+    // Orphaned every frame like the circle instances
+    glBufferData(GL_ARRAY_BUFFER, sizeof(Quad) * quadBuffer.length, quadBuffer.data, GL_STREAM_DRAW);
+    glDrawElements(GL_TRIANGLES, quadBuffer.length * 6, GL_UNSIGNED_INT, (void*)0);
+
+    glBindVertexArray(0);
+}
+
+// Prob gonna change it to GPU side rendering, like \/ gonna disappear (probably)
+void drawTriangle(Triangle* triangle) {
+    if (!triangleBuffer.triangles) return;
+    if (triangleBuffer.count >= triangleBuffer.capacity) growTriangleBuffer();
+
+    // Write only, the mapped memory is usually write combined and slow to read back
+    triangleBuffer.triangles[triangleBuffer.count++] = *triangle;
 }
 
 // Used to draw the cell
@@ -233,11 +423,9 @@ void drawRectangle(Rectangle rect) {
                         }
                   };
 
-    Triangle t1 = { v[0], v[2], v[1] };
-    Triangle t2 = { v[0], v[2], v[3] };
-
-    drawTriangle(&t1);
-    drawTriangle(&t2);
+    // Corners go around the rectangle, the index buffer splits it along v[0] v[2]
+    Quad quad = {{ v[0], v[1], v[2], v[3] }};
+    append_vector_Quad(&quadBuffer, quad);
 }
 
 GLFWwindow* initialize() {
@@ -271,10 +459,7 @@ GLFWwindow* initialize() {
 
 // Generates a random number bewteen min and max inclusive
 void gen_valid_rand(int* num, int min, int max) {
-    *num = rand() % (max + 1);
-    while(*num < min) {
-        *num = rand() % (max + 1);
-    }
+    *num = rng_range(rng_local(), min, max);
 }
 
 // Is inside inclusive with edges
@@ -452,15 +637,13 @@ void clear_wall(maze* maze, int2 pos, Direction dir) {
 void gen_maze(maze* maze, int* step) {
     int2 pos;
 
-    srand(time(NULL));
-
     uint8_t* cell;
     Direction rand_dir;
 
     gen_valid_rand(&pos.x, 0, MAZE_WITDH - 1);
     gen_valid_rand(&pos.y, 0, MAZE_WITDH - 1);
 
-    rand_dir = rand() % 4;
+    rand_dir = rng_below(rng_local(), 4);
 
     toggle_wall(maze, pos, rand_dir);
     step++;
@@ -485,13 +668,16 @@ void renderScene(GLFWwindow* window, maze* maze) {
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
 
-    triangleBuffer.count = 0;
+    beginTriangles();
+    quadBuffer.length = 0;
 
     // Test
     // Rectangle a = {{200.0f, 204.0f}, {50.0f, 100.0f}, {255, 255, 0, 255}};
     // drawRectangle(a);
     render_maze(maze);
 
+    // Quads first, everything else is drawn on top of the grid
+    sendQuadsToGPU();
     sendTrianglesToGPU();
 
     glfwSwapBuffers(window);
@@ -520,16 +706,26 @@ void gameLoop(GLFWwindow* window, maze* maze) {
 
 
 int main(int argc, const char * argv[]) {
-    srand(time(NULL));
+    uint64_t seed = rng_time_seed();
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        }
+    }
+    rng_set_seed(seed);
+    printf("Seed: %llu\n", (unsigned long long)seed);
 
 
     GLFWwindow* window = initialize();
     initTriangleRenderer(&triangleVAO, &triangleVBO);
+    initQuadRenderer(&quadVAO, &quadVBO, &quadEBO);
 
     const char* vertSrc = load_file_as_string("Shaders/triangle_shader.vert");
     const char* fragSrc = load_file_as_string("Shaders/triangle_shader.frag");
 
     shaderProgram = createShaderProgram(vertSrc, fragSrc);
+    projectionLoc = glGetUniformLocation(shaderProgram, "uProjection");
+    updateProjection((float2){0.0f, 0.0f}, 1.0f);
 
     free((void*)vertSrc);
     free((void*)fragSrc);
@@ -540,6 +736,7 @@ int main(int argc, const char * argv[]) {
     gameLoop(window, &actual_maze);
     glfwTerminate();
 
+    free_vector_Quad(&quadBuffer);
 
     return EXIT_SUCCESS;
 }
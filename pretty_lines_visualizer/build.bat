@@ -1,5 +1,5 @@
 cls
 
-gcc app.c utils.c -o pretty_lines_visualizer.exe -lglfw3 -lglew32 -lopengl32 -lgdi32 -luser32 -lkernel32
+gcc app.c utils.c rng.c -o pretty_lines_visualizer.exe -lglfw3 -lglew32 -lopengl32 -lgdi32 -luser32 -lkernel32
 
 .\pretty_lines_visualizer.exe